@@ -1,6 +1,15 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+// Knob filmstrip resolution: 2 degrees per frame over the 300 degree travel
+static constexpr int numKnobFrames = 151;
+
+// Share of the block deadline, as shown in the DSP load readout
+static juce::String percent(float load)
+{
+    return juce::String(juce::roundToInt(load * 100.0f)) + "%";
+}
+
 //==============================================================================
 PunkDistEditor::PunkDistEditor (PunkDistAudioProcessor& p) : AudioProcessorEditor(&p), audioProcessor (p)
 {
@@ -14,6 +23,40 @@ PunkDistEditor::PunkDistEditor (PunkDistAudioProcessor& p) : AudioProcessorEdito
     setSliderComponent(tone2Knob, tone2KnobAttachment, "TONE2", "Rot");
     
     setToggleComponent(onToggle, onToggleAttachment, "ONOFF");
+    
+    // Dirty regions: a knob's cell when it turns to another frame, the light when it switches
+    for (auto& knob : knobs) {
+        knob.frame = knobFrame(*knob.slider);
+        knob.slider->onValueChange = [this, &knob] {
+            const int frame = knobFrame(*knob.slider);
+            if (frame != knob.frame) {
+                knob.frame = frame;
+                repaint(knobCell(knob));
+            }
+        };
+    }
+    lightOn = onToggle.getToggleState();
+    onToggle.onStateChange = [this] {
+        if (onToggle.getToggleState() != lightOn) {
+            lightOn = onToggle.getToggleState();
+            repaint(lightBounds());
+        }
+    };
+    
+    // ================= MODEL ========================
+    modelButton.setColour(juce::TextButton::buttonColourId, juce::Colours::transparentBlack);
+    modelButton.setColour(juce::ComboBox::outlineColourId, juce::Colours::transparentBlack);
+    modelButton.onClick = [this] { showModelMenu(); };
+    addAndMakeVisible(modelButton);
+    
+    perfLabel.setFont(juce::Font(11.0f));
+    perfLabel.setJustificationType(juce::Justification::centred);
+    perfLabel.setColour(juce::Label::textColourId, juce::Colours::white.withAlpha(0.8f));
+    perfLabel.setInterceptsMouseClicks(false, false);
+    addChildComponent(perfLabel);
+    
+    timerCallback();
+    startTimerHz(4);
 
     // ================= ASSETS =======================
     background = juce::ImageCache::getFromMemory(BinaryData::background_png, BinaryData::background_pngSize);
@@ -27,36 +70,101 @@ PunkDistEditor::PunkDistEditor (PunkDistAudioProcessor& p) : AudioProcessorEdito
 
 PunkDistEditor::~PunkDistEditor()
 {
+    stopTimer();
 }
 
 //==============================================================================
 void PunkDistEditor::paint (juce::Graphics& g)
 {
-    g.drawImageWithin(background, 0, 0, getWidth(), getHeight(), juce::RectanglePlacement::stretchToFit);
+    // Layers are drawn at the physical pixel scale, so every image below lands 1:1 on the
+    // screen; they are redrawn when the editor moves to a display with another scale
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (scale != layerScale)
+        updateLayers(scale);
+    
+    // =========== Background, with the light off when bypassed ====
+    g.drawImage(onToggle.getToggleState() ? backgroundOn : backgroundOff, getLocalBounds().toFloat());
     
-    // =========== On/Off state ====================
-    if (!onToggle.getToggleState()) {
+    // ========== Parameter knobs the repaint reaches ==================
+    for (const auto& knob : knobs) {
+        const auto cell = knobCell(knob);
+        if (g.clipRegionIntersects(cell))
+            g.drawImage((*knob.frames)[(size_t) knobFrame(*knob.slider)], cell.toFloat());
+    }
+}
+
+void PunkDistEditor::updateLayers(float scale)
+{
+    layerScale = scale;
+    
+    backgroundOn = juce::Image(juce::Image::ARGB, juce::roundToInt(getWidth() * scale), juce::roundToInt(getHeight() * scale), true);
+    {
+        juce::Graphics layer(backgroundOn);
+        layer.addTransform(juce::AffineTransform::scale(scale));
+        layer.setImageResamplingQuality(juce::Graphics::highResamplingQuality);
+        layer.drawImageWithin(background, 0, 0, getWidth(), getHeight(), juce::RectanglePlacement::stretchToFit);
+    }
+    
+    backgroundOff = backgroundOn.createCopy();
+    {
+        juce::Graphics layer(backgroundOff);
+        layer.addTransform(juce::AffineTransform::scale(scale));
+        layer.setImageResamplingQuality(juce::Graphics::highResamplingQuality);
         juce::AffineTransform t;
         t = t.scaled(0.485f);
         t = t.translated(75.5, 163.5);
-        g.drawImageTransformed(lightOff, t);
+        layer.drawImageTransformed(lightOff, t);
     }
     
-    // ========== Parameter knobs angle in radians ==================
-    float driveRadians = juce::jmap(driveKnob.getValue(), -150.0, 150.0) * DEG2RADS;
-    float levelRadians = juce::jmap(levelKnob.getValue(), -30.0, 30.0, -150.0, 150.0) * DEG2RADS;
-    float tone1Radians = juce::jmap(tone1Knob.getValue(), 0.0, 10.0, -150.0, 150.0) * DEG2RADS;
-    float tone2Radians = juce::jmap(tone2Knob.getValue(), 0.0, 10.0, -150.0, 150.0) * DEG2RADS;
+    for (auto& knob : knobs) {
+        const auto cell = knobCell(knob);
+        knob.frames = &getKnobFrames(scale, knob.position - cell.getPosition().toFloat());
+    }
+}
+
+const std::vector<juce::Image>& PunkDistEditor::getKnobFrames(float scale, juce::Point<float> offset)
+{
+    // Knobs at the same sub-pixel offset share frames; so do editors on the same display
+    auto& frames = filmstrips->frames[juce::String(scale) + " " + offset.toString()];
+    if (!frames.empty())
+        return frames;
     
-    // ========== Draw parameter knobs ==================
-    g.drawImageTransformed(knobImage, knobRotation(driveRadians, 23.5, 23));
-    g.drawImageTransformed(knobImage, knobRotation(levelRadians, 112.5, 23));
-    g.drawImageTransformed(knobImage, knobRotation(tone1Radians, 23.5, 91));
-    g.drawImageTransformed(knobImage, knobRotation(tone2Radians, 112.5, 91));
+    const int size = (int) std::ceil(juce::jmax(offset.x, offset.y) + knobImage.getWidth() * KNOB_SCALE);
+    for (int i = 0; i < numKnobFrames; ++i) {
+        juce::Image frame(juce::Image::ARGB, juce::roundToInt(size * scale), juce::roundToInt(size * scale), true);
+        juce::Graphics g(frame);
+        g.addTransform(juce::AffineTransform::scale(scale));
+        g.setImageResamplingQuality(juce::Graphics::highResamplingQuality);
+        const float degrees = juce::jmap((float) i, 0.0f, (float) (numKnobFrames - 1), -150.0f, 150.0f);
+        g.drawImageTransformed(knobImage, knobRotation(degrees * DEG2RADS, offset.x, offset.y));
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+juce::Rectangle<int> PunkDistEditor::knobCell(const KnobView& knob) const
+{
+    const auto origin = knob.position.toInt();
+    const auto offset = knob.position - origin.toFloat();
+    const int size = (int) std::ceil(juce::jmax(offset.x, offset.y) + knobImage.getWidth() * KNOB_SCALE);
+    return { origin.x, origin.y, size, size };
+}
+
+int PunkDistEditor::knobFrame(const juce::Slider& slider) const
+{
+    // The knobs turn through 300 degrees, linearly over the slider's range
+    return juce::roundToInt(slider.valueToProportionOfLength(slider.getValue()) * (numKnobFrames - 1));
+}
+
+juce::Rectangle<int> PunkDistEditor::lightBounds() const
+{
+    return juce::Rectangle<float>(75.5f, 163.5f, lightOff.getWidth() * 0.485f, lightOff.getHeight() * 0.485f).getSmallestIntegerContainer();
 }
 
 void PunkDistEditor::resized()
 {
+    layerScale = 0.0f;
+    
     // Upper row
     driveKnob.setBounds(24, 23, 46, 46);
     levelKnob.setBounds(113, 23, 46, 46);
@@ -67,6 +175,89 @@ void PunkDistEditor::resized()
     
     // OnOff
     onToggle.setBounds(65, 240, 50, 50);
+    
+    // Model file, with the DSP load above it
+    modelButton.setBounds(10, 298, 160, 18);
+    perfLabel.setBounds(10, 284, 160, 14);
+}
+
+void PunkDistEditor::showModelMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Load model...");
+    menu.addItem(2, "Built-in model", audioProcessor.getModelFile() != juce::File());
+    menu.addSeparator();
+    menu.addItem(3, "Show DSP load", true, audioProcessor.showPerfReadout);
+    if (audioProcessor.showPerfReadout) {
+        // Share of the block deadline per stage: p50 / p99 / max
+        const auto& stats = audioProcessor.getPerfStats();
+        for (int stage = 0; stage < PerfMonitor::numStages; ++stage)
+            menu.addItem(juce::String("    ") + PerfMonitor::getStageName(stage) + "  " + percent(stats.stages[stage].p50) + " / "
+                             + percent(stats.stages[stage].p99) + " / " + percent(stats.stages[stage].max),
+                         false, false, nullptr);
+    }
+    menu.addItem(4, audioProcessor.isPerfTracing() ? "Stop timing trace" : "Record timing trace");
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&modelButton), [this](int result) {
+        if (result == 2)
+            audioProcessor.loadModel({});
+        if (result == 3) {
+            audioProcessor.showPerfReadout = !audioProcessor.showPerfReadout;
+            updatePerfLabel();
+        }
+        if (result == 4) {
+            if (audioProcessor.isPerfTracing()) {
+                audioProcessor.stopPerfTrace();
+            } else {
+                const auto file = audioProcessor.getDefaultTraceFile();
+                if (audioProcessor.startPerfTrace(file))
+                    file.getParentDirectory().revealToUser();
+            }
+            updatePerfLabel();
+        }
+        if (result != 1)
+            return;
+        
+        modelChooser = std::make_unique<juce::FileChooser>("Load model", audioProcessor.getModelFile(), "*.json;*.bin");
+        modelChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this](const juce::FileChooser& chooser) {
+            const auto file = chooser.getResult();
+            if (file != juce::File())
+                audioProcessor.loadModel(file);
+        });
+    });
+}
+
+void PunkDistEditor::timerCallback()
+{
+    const auto error = audioProcessor.getModelError();
+    const auto file = audioProcessor.getModelFile();
+    
+    juce::String text = file == juce::File() ? "Built-in model" : file.getFileNameWithoutExtension();
+    if (audioProcessor.isModelLoading())
+        text = "Loading " + text + "...";
+    else if (error.isNotEmpty())
+        text = "Load failed: " + text;
+    
+    modelButton.setButtonText(text);
+    modelButton.setTooltip(error);
+    
+    updatePerfLabel();
+}
+
+void PunkDistEditor::updatePerfLabel()
+{
+    perfLabel.setVisible(audioProcessor.showPerfReadout || audioProcessor.isPerfTracing());
+    if (!perfLabel.isVisible())
+        return;
+    
+    const auto& stats = audioProcessor.getPerfStats();
+    juce::String text = "#" + juce::String(audioProcessor.getInstanceId()) + " DSP " + percent(stats.total.p50)
+                        + " p99 " + percent(stats.total.p99) + " max " + percent(stats.total.max);
+    if (stats.deadlineMisses > 0)
+        text << " late " << juce::String((juce::int64) stats.deadlineMisses);
+    if (audioProcessor.isPerfTracing())
+        text = "REC " + text;
+    perfLabel.setText(text, juce::dontSendNotification);
 }
 
 void PunkDistEditor::setSliderComponent(juce::Slider &slider, std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> &sliderAttachment, juce::String paramName, juce::String style){
@@ -92,7 +283,7 @@ void PunkDistEditor::setToggleComponent(juce::ToggleButton& button, std::unique_
 juce::AffineTransform PunkDistEditor::knobRotation(float radians, float posX, float posY){
     juce::AffineTransform t;
     t = t.rotated(radians, 46.0f, 46.0f);
-    t = t.scaled(0.48f);
+    t = t.scaled(KNOB_SCALE);
     t = t.translated(posX, posY);
     return t;
 }
@@ -4,11 +4,13 @@
 #include "BinaryData.h"
 
 #define DEG2RADS 0.0174533f
+#define KNOB_SCALE 0.48f
 
 //==============================================================================
 /**
 */
-class PunkDistEditor : public juce::AudioProcessorEditor
+class PunkDistEditor : public juce::AudioProcessorEditor,
+                       private juce::Timer
 {
 public:
     PunkDistEditor (PunkDistAudioProcessor&);
@@ -40,6 +42,16 @@ private:
     juce::ToggleButton onToggle;
     std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> onToggleAttachment;
     
+    // Model file: shows the loaded model and opens the load menu
+    juce::TextButton modelButton;
+    std::unique_ptr<juce::FileChooser> modelChooser;
+    void showModelMenu();
+    void timerCallback() override;
+    
+    // Optional DSP load readout above the model button; the model menu splits it by stage
+    juce::Label perfLabel;
+    void updatePerfLabel();
+    
     // Assets - Background, knobs and switch
     juce::Image background;
     
@@ -47,6 +59,38 @@ private:
         
     juce::Image knobImage;
     
+    // Cached rendering: the background is drawn once per display scale, with and without the
+    // light, and each knob is a frame of a pre-rotated filmstrip, so paint() only copies
+    // pixels. A knob repaints its own cell, and only when its frame changes.
+    struct KnobView
+    {
+        juce::Slider* slider;
+        juce::Point<float> position; // of the knob image, as passed to knobRotation()
+        int frame = -1;
+        const std::vector<juce::Image>* frames = nullptr;
+    };
+    std::array<KnobView, 4> knobs { { { &driveKnob, { 23.5f, 23.0f } },
+                                      { &levelKnob, { 112.5f, 23.0f } },
+                                      { &tone1Knob, { 23.5f, 91.0f } },
+                                      { &tone2Knob, { 112.5f, 91.0f } } } };
+    
+    // Knob frames per display scale and sub-pixel offset, shared by every open editor
+    struct KnobFilmstrips
+    {
+        std::map<juce::String, std::vector<juce::Image>> frames;
+    };
+    juce::SharedResourcePointer<KnobFilmstrips> filmstrips;
+    
+    juce::Image backgroundOn, backgroundOff;
+    float layerScale = 0.0f;
+    bool lightOn = true;
+    
+    void updateLayers(float scale);
+    const std::vector<juce::Image>& getKnobFrames(float scale, juce::Point<float> offset);
+    juce::Rectangle<int> knobCell(const KnobView& knob) const;
+    int knobFrame(const juce::Slider& slider) const;
+    juce::Rectangle<int> lightBounds() const;
+    
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     PunkDistAudioProcessor& audioProcessor;
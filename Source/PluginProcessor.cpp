@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "ModelAccuracy.h"
 
 //==============================================================================
 PunkDistAudioProcessor::PunkDistAudioProcessor()
@@ -14,10 +15,22 @@ PunkDistAudioProcessor::PunkDistAudioProcessor()
                        ), state(*this, nullptr, "parameters", createParams())
 #endif
 {
+    onOffParam = state.getRawParameterValue("ONOFF");
+    driveParam = state.getRawParameterValue("DRIVE");
+    levelParam = state.getRawParameterValue("LEVEL");
+    tone1Param = state.getRawParameterValue("TONE1");
+    tone2Param = state.getRawParameterValue("TONE2");
+    resampleParam = state.getRawParameterValue("RESAMPLE");
+    idleParam = state.getRawParameterValue("IDLE");
+    ecoParam = state.getRawParameterValue("ECO");
+    weightsParam = state.getRawParameterValue("WEIGHTS");
+
+    startTimerHz(10);
 }
 
 PunkDistAudioProcessor::~PunkDistAudioProcessor()
 {
+    stopTimer();
 }
 
 //==============================================================================
@@ -55,7 +68,9 @@ bool PunkDistAudioProcessor::isMidiEffect() const
 
 double PunkDistAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // The resampling filters keep ringing for as long as they delay the signal
+    const double sampleRate = getSampleRate();
+    return sampleRate > 0.0 ? latencySamples.load() / sampleRate : 0.0;
 }
 
 int PunkDistAudioProcessor::getNumPrograms()
@@ -95,6 +110,12 @@ juce::AudioProcessorValueTreeState::ParameterLayout PunkDistAudioProcessor::crea
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("LEVEL", 0), "Output Level", juce::NormalisableRange<float>(-30.0f, 30.0f, 0.1f), DEFAULT_LEVEL, "dB"));
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("TONE1", 0), "Tone 1", juce::NormalisableRange<float>(0.0f, 10.0f, 0.1f), DEFAULT_TONE1, ""));
     params.push_back(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("TONE2", 0), "Tone 2", juce::NormalisableRange<float>(0.0f, 10.0f, 0.1f), DEFAULT_TONE2, ""));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("RESAMPLE", 0), "Model Rate", juce::StringArray { "Host", "Eco", "Normal", "High" }, 0,
+                                                                  juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    params.push_back(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("IDLE", 0), "Idle Sleep", true, juce::AudioParameterBoolAttributes().withAutomatable(false)));
+    params.push_back(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("ECO", 0), "Eco Mode", false, juce::AudioParameterBoolAttributes().withAutomatable(false)));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("WEIGHTS", 0), "Model Weights", juce::StringArray { "Float32", "Float16", "Int8" }, 0,
+                                                                  juce::AudioParameterChoiceAttributes().withAutomatable(false)));
     
     return { params.begin(), params.end() };
 }
@@ -102,41 +123,113 @@ juce::AudioProcessorValueTreeState::ParameterLayout PunkDistAudioProcessor::crea
 // ============ VALUE UPDATERS =====================
 void PunkDistAudioProcessor::updateOnOff()
 {
-    auto ONOFF = state.getRawParameterValue("ONOFF");
-    on = ONOFF->load();
+    on = onOffParam->load() > 0.5f;
 }
 
 void PunkDistAudioProcessor::updateDrive()
 {
-    auto IN = state.getRawParameterValue("DRIVE");
-    driveValue = IN->load();
+    driveValue = driveParam->load();
+    models.setDrive(driveValue);
+
+    // The glide is counted in samples at the rate the model runs at
+    auto& model = models.current();
+    const double modelRate = resamplingActive() ? model.getModelSampleRate() : getSampleRate();
+    model.setDriveRampSamples((int) (DRIVE_GLIDE_SECONDS * modelRate));
 }
 
 void PunkDistAudioProcessor::updateLevel()
 {
-    auto OUT = state.getRawParameterValue("LEVEL");
-    float val = OUT->load();
-    outputLevel.setGainDecibels(val);
+    outputStage.setGainDecibels(levelParam->load());
 }
 
 void PunkDistAudioProcessor::updateTone()
 {
-    auto TONE1 = state.getRawParameterValue("TONE1")->load();
-    auto TONE2 = state.getRawParameterValue("TONE2")->load();
-    float tone1freq = juce::jmap(TONE1, 0.f, 10.f, 200.f, 2500.f);
-    float tone1gain = juce::jmap(TONE1, 0.f, 10.f, 1.f, 2.5f);
-    float tone2dip = juce::Decibels::decibelsToGain(TONE2 * (-2.0f));
-    float tone2bump = juce::jmap(TONE2, 0.f, 10.f, 1.f, 1.5f);
+    // Automation: a move glides the coefficients sample by sample to the new response over
+    // a fixed time, carrying on across blocks. It starts with the block that sees the move.
+    const float tone1 = tone1Param->load();
+    const float tone2 = tone2Param->load();
+    
+    if (toneDirty) {
+        setToneCoefficients(tone1, tone2, 0);
+        toneDirty = false;
+    } else if (tone1 != tone1Value || tone2 != tone2Value) {
+        setToneCoefficients(tone1, tone2, (int) (TONE_GLIDE_SECONDS * getSampleRate()));
+    }
+    
+    tone1Value = tone1;
+    tone2Value = tone2;
+}
+
+void PunkDistAudioProcessor::setToneCoefficients(float tone1, float tone2, int rampSamples)
+{
+    float tone1freq = juce::jmap(tone1, 0.f, 10.f, 200.f, 2500.f);
+    float tone1gain = juce::jmap(tone1, 0.f, 10.f, 1.f, 2.5f);
+    float tone2dip = juce::Decibels::decibelsToGain(tone2 * (-2.0f));
+    float tone2bump = juce::jmap(tone2, 0.f, 10.f, 1.f, 1.5f);
     
-    float sampleRate = getSampleRate();
-    *eq.get<1>().state = *juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, tone1freq, 0.7071f, tone1gain);
-    *eq.get<2>().state = *juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, 800.0f, 1.5f, tone2dip);
-    *eq.get<3>().state = *juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, 80.0f, 0.7071f, tone2bump);
+    // ArrayCoefficients are computed on the stack, so nothing is allocated on the audio thread.
+    // A flat section (tone1 at 0) is skipped by the cascade.
+    double sampleRate = getSampleRate();
+    using Coefficients = juce::dsp::IIR::ArrayCoefficients<float>;
+    auto& eq = outputStage.getTone();
+    eq.setCoefficients(1, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, tone1freq, 0.7071f, tone1gain)), rampSamples);
+    eq.setCoefficients(2, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, 800.0f, 1.5f, tone2dip)), rampSamples);
+    eq.setCoefficients(3, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, 80.0f, 0.7071f, tone2bump)), rampSamples);
+}
+
+void PunkDistAudioProcessor::updateResampling()
+{
+    const int mode = (int) resampleParam->load();
+    if (mode == resampleMode)
+        return;
+
+    resampleMode = mode;
+    if (mode > 0)
+        resampler.setQuality((ModelResampler::Quality) (mode - 1));
+    resampler.reset();
+
+    // The host can only be told about the new delay from the message thread
+    const int newLatency = resamplingActive() ? resampler.getLatencySamples() : 0;
+    latencySamples.store(newLatency);
+
+    // The hold time is counted in model samples
+    updateIdle(true);
+}
+
+void PunkDistAudioProcessor::updateIdle(bool force)
+{
+    const int mode = idleParam->load() > 0.5f ? 1 : 0;
+    if (mode == idleMode && !force)
+        return;
+
+    idleMode = mode;
+    auto& model = models.current();
+    const double modelRate = resamplingActive() ? model.getModelSampleRate() : getSampleRate();
+    if (mode == 1)
+        model.setIdleDetection(juce::Decibels::decibelsToGain(IDLE_THRESHOLD_DB), (int) (IDLE_HOLD_SECONDS * modelRate));
+    else
+        model.setIdleDetection(0.0f, 0);
+}
+
+void PunkDistAudioProcessor::updateEco()
+{
+    // Approximated activations and reduced-precision weights for tracking and monitoring;
+    // offline renders stay exact
+    const bool realtime = !isNonRealtime();
+    auto& model = models.current();
+    model.setEcoMode(ecoParam->load() > 0.5f && realtime);
+    model.setPrecision(realtime ? (LSTMWeights::Precision) (int) weightsParam->load() : LSTMWeights::Precision::Float32);
 }
 
 void PunkDistAudioProcessor::updateState()
 {
+    // A newly loaded model starts with default settings
+    const bool modelChanged = models.acquire();
+
     updateOnOff();
+    updateResampling();
+    updateIdle(modelChanged);
+    updateEco();
     updateTone();
     updateDrive();
     updateLevel();
@@ -145,26 +238,35 @@ void PunkDistAudioProcessor::updateState()
 //==============================================================================
 void PunkDistAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    juce::dsp::ProcessSpec spec;
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = getTotalNumOutputChannels();
-    spec.sampleRate = sampleRate;
+    const int numChannels = getTotalNumOutputChannels();
+    
+    // A model that finished loading while stopped needs no crossfade
+    models.adoptPending();
     
-    // Read json model
-    juce::MemoryInputStream jsonInputStream(BinaryData::minidist_model_json, BinaryData::minidist_model_jsonSize, false);
-    nlohmann::json weights_json = nlohmann::json::parse(jsonInputStream.readEntireStreamAsString().toStdString());
-    LSTM.reset();
-    LSTM.load_json(weights_json);
+    // Every quality is built up front so RESAMPLE can change without allocating. A model
+    // loaded later with another training rate runs at this one until the next prepare.
+    const double modelRate = models.current().getModelSampleRate();
+    resampler.prepare(numChannels, samplesPerBlock, sampleRate, modelRate);
+    resampleMode = -1;
+    updateResampling();
+    setLatencySamples(latencySamples.load());
     
-    LSTM2.reset();
-    LSTM2.load_json(weights_json);
+    // Resets the running model (and one still waiting to take over) to its warmed-up rest state
+    // at the current DRIVE, whatever the previous run ended on
+    const double crossfadeRate = resamplingActive() ? modelRate : sampleRate;
+    driveValue = driveParam->load();
+    models.prepare(numChannels, juce::jmax(samplesPerBlock, resampler.getMaxModelBlockSize()), (int) (MODEL_CROSSFADE_SECONDS * crossfadeRate), driveValue);
     
-    eq.prepare(spec);
-    eq.reset();
-    *eq.get<0>().state = *juce::dsp::IIR::Coefficients<float>::makeHighPass(sampleRate, 35.f, 0.7071f);
+    // Same channel count as the model, so the output stage can be fused into its loop
+    outputStage.setRampDurationSeconds(0.05);
+    outputStage.prepare(numChannels, sampleRate);
+    outputStage.reset();
+    outputStage.getTone().setCoefficients(0, BiquadCascade::fromArray(juce::dsp::IIR::ArrayCoefficients<float>::makeHighPass(sampleRate, 35.f, 0.7071f)));
     
-    outputLevel.prepare(spec);
-    outputLevel.setRampDurationSeconds(0.05);
+    // The peak filters depend on the sample rate, so rebuild them on the next block
+    toneDirty = true;
+
+    perf.prepare(sampleRate);
 }
 
 void PunkDistAudioProcessor::releaseResources()
@@ -180,12 +282,9 @@ bool PunkDistAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout works: RT_LSTM batches channels across SIMD lanes, so
+    // mono, stereo, quad and surround buses all share the same engine.
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -204,26 +303,45 @@ void PunkDistAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
     juce::ignoreUnused(midiMessages);
 
     juce::ScopedNoDenormals noDenormals;
+    perf.beginBlock(buffer.getNumSamples());
+    uint32_t perfFlags = 0;
     
     updateState();
     if(on)
     {
-        juce::dsp::AudioBlock<float> audioBlock (buffer);
-                
-        // Model inference
-        for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
-            if (ch == 0)
-                LSTM.process(buffer.getReadPointer(ch), buffer.getWritePointer(ch), driveValue, buffer.getNumSamples());
-            else
-                LSTM2.process(buffer.getReadPointer(ch), buffer.getWritePointer(ch), driveValue, buffer.getNumSamples());
-        }
-                
-        // Tone controls
-        eq.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
+        perf.mark(PerfMonitor::Control);
         
-        // Output level
-        outputLevel.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
+        if (resamplingActive())
+        {
+            // Model inference at its training rate; the tone controls and output level
+            // then run at the host rate on the converted signal
+            const int numChannels = buffer.getNumChannels();
+            resampler.process(buffer.getArrayOfWritePointers(), numChannels, buffer.getNumSamples(), [&](float* const* channels, int numSamples) {
+                perf.mark(PerfMonitor::Resampling);
+                models.process(channels, channels, numChannels, driveValue, numSamples);
+                perf.mark(PerfMonitor::Inference);
+            });
+            perf.mark(PerfMonitor::Resampling);
+            outputStage.process(buffer.getArrayOfWritePointers(), numChannels, buffer.getNumSamples());
+            perf.mark(PerfMonitor::Output);
+            perfFlags |= PerfMonitor::resampled;
+        }
+        else
+        {
+            // Model inference, with the skip connection, tone controls and output level
+            // applied to every sample in the same pass
+            models.process(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), buffer.getNumChannels(), driveValue, buffer.getNumSamples(), &outputStage);
+            perf.mark(PerfMonitor::Inference);
+        }
+    }
+    else
+    {
+        perf.mark(PerfMonitor::Control);
     }
+    
+    const bool sleeping = on && models.current().isSleeping();
+    modelSleeping.store(sleeping, std::memory_order_relaxed);
+    perf.endBlock(perfFlags | (sleeping ? PerfMonitor::modelAsleep : 0u));
 }
 
 //==============================================================================
@@ -238,20 +356,87 @@ juce::AudioProcessorEditor* PunkDistAudioProcessor::createEditor()
 }
 
 //==============================================================================
+void PunkDistAudioProcessor::loadModel(const juce::File& file)
+{
+    models.load(file.getFullPathName().toStdString());
+}
+
+juce::File PunkDistAudioProcessor::getModelFile() const
+{
+    const auto path = juce::String::fromUTF8(models.getModelPath().c_str());
+    return path.isEmpty() ? juce::File() : juce::File(path);
+}
+
+int PunkDistAudioProcessor::getPreRollSamples(float maxError) const
+{
+    // A difference at the model output reaches the plugin output through LEVEL and, at
+    // worst, both tone boosts
+    const double worstGain = juce::Decibels::decibelsToGain(levelParam->load()) * 2.5 * 1.5;
+    const int modelPreRoll = ModelAccuracy::preRollSamples(models.current().getWeights(), (float) (maxError / worstGain));
+    if (modelPreRoll < 0)
+        return -1;
+
+    const double sampleRate = getSampleRate();
+    const double modelRate = resamplingActive() ? models.current().getModelSampleRate() : sampleRate;
+
+    // The slowest tone filter is the 35 Hz high-pass: with Q 0.7071 its state shrinks by
+    // exp(-2 pi 35 * 0.7071 / sampleRate) per sample
+    const double decayPerSample = juce::MathConstants<double>::twoPi * 35.0 * 0.7071 / sampleRate;
+    const int toneSettle = (int) std::ceil(std::log(worstGain / maxError) / decayPerSample);
+
+    // The resampling filters need their whole length of history
+    return juce::jmax((int) std::ceil(modelPreRoll * sampleRate / modelRate), toneSettle) + 2 * latencySamples.load();
+}
+
+bool PunkDistAudioProcessor::startPerfTrace(const juce::File& file)
+{
+    return file.getParentDirectory().createDirectory() && perf.startTrace(file.getFullPathName().toStdString());
+}
+
+juce::File PunkDistAudioProcessor::getDefaultTraceFile() const
+{
+    const auto name = juce::String(JucePlugin_Name) + "-" + juce::String(getInstanceId()) + "-"
+                      + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".pdtrace";
+    return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile(JucePlugin_Name).getChildFile(name);
+}
+
+void PunkDistAudioProcessor::timerCallback()
+{
+    perf.collect();
+    models.reclaim();
+
+    // Polled rather than posted: posting a message from the audio thread locks and allocates
+    const int latency = latencySamples.load();
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+}
+
 void PunkDistAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // Parameters, plus the file of a user-loaded model (empty for the built-in one)
+    auto stateTree = state.copyState();
+    stateTree.setProperty("modelFile", getModelFile().getFullPathName(), nullptr);
 
-    juce::ignoreUnused(destData);
+    if (auto xml = stateTree.createXml())
+        copyXmlToBinary(*xml, destData);
 }
 
 void PunkDistAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // Preset loader
-
-    juce::ignoreUnused(data, sizeInBytes);
+    auto xml = getXmlFromBinary(data, sizeInBytes);
+    if (xml == nullptr || !xml->hasTagName(state.state.getType()))
+        return;
+
+    auto stateTree = juce::ValueTree::fromXml(*xml);
+    const auto modelFile = stateTree.getProperty("modelFile").toString();
+    stateTree.removeProperty("modelFile", nullptr);
+    state.replaceState(stateTree);
+
+    // The current model keeps playing until the saved one has loaded in the background.
+    // A missing file leaves it in place and reports the error.
+    if (modelFile != getModelFile().getFullPathName())
+        loadModel(modelFile.isEmpty() ? juce::File() : juce::File(modelFile));
 }
 
 //==============================================================================
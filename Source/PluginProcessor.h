@@ -2,7 +2,11 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_dsp/juce_dsp.h>
-#include "RTNeuralLSTM.h"
+#include "BinaryData.h"
+#include "ModelSwap.h"
+#include "OutputStage.h"
+#include "ModelResampler.h"
+#include "PerfMonitor.h"
 
 #if (MSVC)
 #include "ipps.h"
@@ -13,10 +17,23 @@
 #define DEFAULT_TONE1 5.0f
 #define DEFAULT_TONE2 5.0f
 
+// Idle detection: inference stops after this long below the threshold
+#define IDLE_THRESHOLD_DB -90.0f
+#define IDLE_HOLD_SECONDS 0.1
+
+// Length of the crossfade when a newly loaded model takes over
+#define MODEL_CROSSFADE_SECONDS 0.05
+
+// Parameter glides, fixed in time whatever the host's block size. Each starts at the first
+// block boundary after the move, so when it starts still depends on how the host cuts blocks.
+#define DRIVE_GLIDE_SECONDS 0.02
+#define TONE_GLIDE_SECONDS 0.05
+
 //==============================================================================
 /**
 */
-class PunkDistAudioProcessor  : public juce::AudioProcessor
+class PunkDistAudioProcessor  : public juce::AudioProcessor,
+                                private juce::Timer
 {
 public:
     //==============================================================================
@@ -59,20 +76,82 @@ public:
     //=============== MY STUFF =====================================================
     juce::AudioProcessorValueTreeState state;
 
+    // True while the model is asleep on silent input (diagnostics only)
+    bool isModelSleeping() const noexcept { return modelSleeping.load(std::memory_order_relaxed); }
+
+    // Loads a model file (training .json or packed .bin) in the background and crossfades to
+    // it once it is ready; an empty File goes back to the built-in model. Message thread.
+    void loadModel(const juce::File& file);
+    juce::File getModelFile() const;
+    juce::String getModelError() const { return juce::String::fromUTF8(models.getLastError().c_str()); }
+    bool isModelLoading() const noexcept { return models.isLoading(); }
+
+    // Samples of preceding audio a freshly prepared processor must run before its output stays
+    // within maxError of one that has been running all along (model state, tone filters and
+    // resampling), for the current model and settings. Offline renders use it to cut one long
+    // file into chunks rendered in parallel. -1 if the model does not settle. Call after
+    // prepareToPlay; it runs the model for a while, so not on the audio thread.
+    int getPreRollSamples(float maxError) const;
+
+    // DSP load of this instance per stage over the last PerfMonitor::windowSize blocks, and
+    // the blocks that took longer than their own audio. Refreshed ten times a second on the
+    // message thread, which is also where these are called.
+    const PerfMonitor::Stats& getPerfStats() const noexcept { return perf.getStats(); }
+    int getInstanceId() const noexcept { return (int) perf.getInstanceId(); }
+
+    // Opt-in binary trace of every block's stage timings (format in PerfMonitor.h)
+    bool startPerfTrace(const juce::File& file);
+    void stopPerfTrace() { perf.stopTrace(); }
+    bool isPerfTracing() const noexcept { return perf.isTracing(); }
+    juce::File getDefaultTraceFile() const;
+    bool showPerfReadout = false; // editor setting, kept while the editor is closed
+
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParams();
-    using FilterBand = juce::dsp::ProcessorDuplicator<juce::dsp::IIR::Filter<float>, juce::dsp::IIR::Coefficients<float>>;
-    using Gain = juce::dsp::Gain<float>;
     
-    // ML model
-    RT_LSTM LSTM;
-    RT_LSTM LSTM2;
+    // ML model, every channel advanced together across SIMD lanes. Starts on the blob packed
+    // from minidist_model.json at build time; user models are swapped in without locking.
+    ModelSwap models { BinaryData::minidist_model_bin, (size_t) BinaryData::minidist_model_binSize };
+    
+    // Parameter pointers, looked up once instead of by ID on every block
+    std::atomic<float>* onOffParam = nullptr;
+    std::atomic<float>* driveParam = nullptr;
+    std::atomic<float>* levelParam = nullptr;
+    std::atomic<float>* tone1Param = nullptr;
+    std::atomic<float>* tone2Param = nullptr;
+    std::atomic<float>* resampleParam = nullptr;
+    std::atomic<float>* idleParam = nullptr;
+    std::atomic<float>* ecoParam = nullptr;
+    std::atomic<float>* weightsParam = nullptr;
     
     // Modifiable parameters
     float driveValue = DEFAULT_DRIVE;
-    juce::dsp::ProcessorChain<FilterBand, FilterBand, FilterBand, FilterBand> eq;
-    Gain outputLevel;
+    // Tone controls (35 Hz high-pass, tone1 peak, 800 Hz dip, 80 Hz bump) and output level,
+    // applied by RT_LSTM to each sample as it leaves the model
+    OutputStage outputStage;
     bool on;
+    
+    // Tone coefficients are only recomputed when TONE1/TONE2 move, or after a sample rate
+    // change; the cascade then glides to the new response on its own
+    float tone1Value = DEFAULT_TONE1;
+    float tone2Value = DEFAULT_TONE2;
+    bool toneDirty = true;
+
+    // Optional conversion to the model's training rate. RESAMPLE is 0 (off) or
+    // 1 + ModelResampler::Quality; the latency it adds is reported from the message thread.
+    ModelResampler resampler;
+    int resampleMode = -1;
+    std::atomic<int> latencySamples { 0 };
+    bool resamplingActive() const noexcept { return resampleMode > 0 && resampler.isActive(); }
+
+    // Stage timings, written on the audio thread and collected by the timer, which also
+    // reports latency changes to the host
+    PerfMonitor perf;
+    void timerCallback() override;
+
+    // Idle detection, timed at the rate the model actually runs at
+    int idleMode = -1;
+    std::atomic<bool> modelSleeping { false };
 
     // Updaters
     void updateOnOff();
@@ -80,6 +159,10 @@ private:
     void updateLevel();
     void updateTone();
     void updateState();
+    void setToneCoefficients(float tone1, float tone2, int rampSamples);
+    void updateResampling();
+    void updateIdle(bool force);
+    void updateEco();
     
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PunkDistAudioProcessor)
@@ -0,0 +1,282 @@
+// Headless performance baseline: times RT_LSTM::process (steady and ramping drive), the tone
+// EQ chain and the whole PunkDistAudioProcessor::processBlock over a grid of block sizes,
+// sample rates and channel counts, and prints the results as JSON or CSV.
+//
+//   Benchmarks [--format json|csv] [--output file] [--seconds s] [--repeats n]
+//              [--cases a,b] [--blocks 16,64] [--rates 44100,96000] [--channels 1,2]
+//
+// ns_per_sample is wall time per sample frame (all channels), median over the repeats.
+// realtime_factor is audio time over processing time, so 100 means the case uses 1% of
+// the real-time budget.
+
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string format = "json";
+        std::string output;
+        double seconds = 1.0;
+        int repeats = 5;
+        std::vector<std::string> cases { "lstm_steady", "lstm_ramp", "tone_eq", "process_block" };
+        std::vector<int> blockSizes { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+        std::vector<int> sampleRates { 44100, 48000, 88200, 96000, 176400, 192000 };
+        std::vector<int> channelCounts { 1, 2 };
+    };
+
+    struct Result
+    {
+        std::string name;
+        int blockSize, sampleRate, numChannels;
+        double nsPerSample, nsPerSampleMin, realtimeFactor;
+    };
+
+    template <typename T>
+    std::vector<T> parseList(const std::string& text)
+    {
+        std::vector<T> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if constexpr (std::is_same_v<T, std::string>)
+                values.push_back(item);
+            else
+                values.push_back((T) std::stod(item));
+        }
+        return values;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (i + 1 >= argc)
+                return false;
+
+            const std::string value = argv[++i];
+            if (arg == "--format" && (value == "json" || value == "csv"))
+                options.format = value;
+            else if (arg == "--output")
+                options.output = value;
+            else if (arg == "--seconds")
+                options.seconds = std::max(0.01, std::stod(value));
+            else if (arg == "--repeats")
+                options.repeats = std::max(1, std::stoi(value));
+            else if (arg == "--cases")
+                options.cases = parseList<std::string>(value);
+            else if (arg == "--blocks")
+                options.blockSizes = parseList<int>(value);
+            else if (arg == "--rates")
+                options.sampleRates = parseList<int>(value);
+            else if (arg == "--channels")
+                options.channelCounts = parseList<int>(value);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // Decaying plucked notes over a little noise: never silent, so idle detection stays out
+    // of the way, and the same on every run
+    std::vector<float> makeSignal(int numSamples, double sampleRate)
+    {
+        std::vector<float> signal((size_t) numSamples);
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> noise(-0.01f, 0.01f);
+
+        const double notes[] = { 82.41, 110.0, 146.83, 196.0 };
+        const int noteLength = (int) (0.5 * sampleRate);
+        for (int i = 0; i < numSamples; ++i) {
+            const double frequency = notes[(i / noteLength) % 4];
+            const double t = (i % noteLength) / sampleRate;
+            double pluck = 0.0;
+            for (int harmonic = 1; harmonic <= 4; ++harmonic)
+                pluck += std::sin(2.0 * juce::MathConstants<double>::pi * frequency * harmonic * t) / harmonic;
+            signal[(size_t) i] = (float) (0.4 * pluck * std::exp(-3.0 * t)) + noise(random);
+        }
+        return signal;
+    }
+
+    // Runs process(buffer) over options.seconds of audio, block by block, once to warm up and
+    // then options.repeats times
+    Result measure(const std::string& name, const Options& options, int blockSize, int sampleRate, int numChannels,
+                   const std::function<void(juce::AudioBuffer<float>&)>& process)
+    {
+        const int numBlocks = std::max(1, (int) (options.seconds * sampleRate) / blockSize);
+        const auto signal = makeSignal(numBlocks * blockSize, sampleRate);
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+
+        auto run = [&] {
+            const auto start = std::chrono::steady_clock::now();
+            for (int b = 0; b < numBlocks; ++b) {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    buffer.copyFrom(ch, 0, signal.data() + (size_t) b * blockSize, blockSize);
+                process(buffer);
+            }
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        run();
+        std::vector<double> times;
+        for (int r = 0; r < options.repeats; ++r)
+            times.push_back(run());
+        std::sort(times.begin(), times.end());
+
+        const double numSamples = (double) numBlocks * blockSize;
+        const double median = times[times.size() / 2];
+
+        Result result;
+        result.name = name;
+        result.blockSize = blockSize;
+        result.sampleRate = sampleRate;
+        result.numChannels = numChannels;
+        result.nsPerSample = median / numSamples;
+        result.nsPerSampleMin = times.front() / numSamples;
+        result.realtimeFactor = (numSamples / sampleRate) / (median * 1.0e-9);
+        return result;
+    }
+
+    Result runCase(const std::string& name, const Options& options, int blockSize, int sampleRate, int numChannels)
+    {
+        using Coefficients = juce::dsp::IIR::ArrayCoefficients<float>;
+
+        if (name == "lstm_steady" || name == "lstm_ramp") {
+            RT_LSTM model;
+            model.load_binary(BinaryData::minidist_model_bin, (size_t) BinaryData::minidist_model_binSize);
+            model.prepare(numChannels, blockSize);
+            model.reset();
+
+            // Ramping: every block glides to a new drive, so the drive is never folded
+            const bool ramp = name == "lstm_ramp";
+            int block = 0;
+            return measure(name, options, blockSize, sampleRate, numChannels, [&](juce::AudioBuffer<float>& buffer) {
+                const float drive = ramp ? ((block++ & 1) ? 0.7f : 0.3f) : 0.5f;
+                model.process(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), numChannels, drive, blockSize);
+            });
+        }
+
+        if (name == "tone_eq") {
+            // The processor's tone stack at its default settings, plus the output gain
+            OutputStage stage;
+            stage.prepare(numChannels, sampleRate);
+            stage.reset();
+            auto& eq = stage.getTone();
+            eq.setCoefficients(0, BiquadCascade::fromArray(Coefficients::makeHighPass(sampleRate, 35.0f, 0.7071f)));
+            eq.setCoefficients(1, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, 1350.0f, 0.7071f, 1.75f)));
+            eq.setCoefficients(2, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, 800.0f, 1.5f, 0.316f)));
+            eq.setCoefficients(3, BiquadCascade::fromArray(Coefficients::makePeakFilter(sampleRate, 80.0f, 0.7071f, 1.25f)));
+            stage.setGainDecibels(-6.0f);
+
+            return measure(name, options, blockSize, sampleRate, numChannels, [&](juce::AudioBuffer<float>& buffer) {
+                stage.process(buffer.getArrayOfWritePointers(), numChannels, blockSize);
+            });
+        }
+
+        // process_block: the plugin as a host would run it, default parameters
+        PunkDistAudioProcessor processor;
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+        layout.outputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+        processor.setBusesLayout(layout);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        juce::MidiBuffer midi;
+        auto result = measure(name, options, blockSize, sampleRate, numChannels, [&](juce::AudioBuffer<float>& buffer) {
+            processor.processBlock(buffer, midi);
+        });
+        processor.releaseResources();
+        return result;
+    }
+
+    std::string toJson(const std::vector<Result>& results, const Options& options)
+    {
+        nlohmann::json json;
+        json["version"] = VERSION;
+        json["build_type"] = CMAKE_BUILD_TYPE;
+        json["kernel"] = LSTMKernels::best().name;
+        json["seconds"] = options.seconds;
+        json["repeats"] = options.repeats;
+
+        json["results"] = nlohmann::json::array();
+        for (const auto& r : results) {
+            json["results"].push_back({ { "case", r.name },
+                                        { "block_size", r.blockSize },
+                                        { "sample_rate", r.sampleRate },
+                                        { "channels", r.numChannels },
+                                        { "ns_per_sample", r.nsPerSample },
+                                        { "ns_per_sample_min", r.nsPerSampleMin },
+                                        { "realtime_factor", r.realtimeFactor } });
+        }
+        return json.dump(2) + "\n";
+    }
+
+    std::string toCsv(const std::vector<Result>& results)
+    {
+        std::string csv = "case,block_size,sample_rate,channels,ns_per_sample,ns_per_sample_min,realtime_factor\n";
+        char line[256];
+        for (const auto& r : results) {
+            std::snprintf(line, sizeof(line), "%s,%d,%d,%d,%.3f,%.3f,%.2f\n", r.name.c_str(), r.blockSize, r.sampleRate, r.numChannels,
+                          r.nsPerSample, r.nsPerSampleMin, r.realtimeFactor);
+            csv += line;
+        }
+        return csv;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: Benchmarks [--format json|csv] [--output file] [--seconds s] [--repeats n]\n"
+                             "                  [--cases a,b] [--blocks 16,64] [--rates 44100,96000] [--channels 1,2]\n");
+        return 1;
+    }
+
+    // The processor's parameters and async updates expect a message manager to exist
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::vector<Result> results;
+    for (const auto& name : options.cases) {
+        if (name != "lstm_steady" && name != "lstm_ramp" && name != "tone_eq" && name != "process_block") {
+            std::fprintf(stderr, "Benchmarks: unknown case %s\n", name.c_str());
+            return 1;
+        }
+
+        for (int numChannels : options.channelCounts)
+            for (int sampleRate : options.sampleRates)
+                for (int blockSize : options.blockSizes) {
+                    results.push_back(runCase(name, options, blockSize, sampleRate, numChannels));
+                    const auto& r = results.back();
+                    std::fprintf(stderr, "%-14s %5d samples %6d Hz %d ch: %8.2f ns/sample, %7.1fx realtime\n", r.name.c_str(), r.blockSize,
+                                 r.sampleRate, r.numChannels, r.nsPerSample, r.realtimeFactor);
+                }
+    }
+
+    const std::string text = options.format == "csv" ? toCsv(results) : toJson(results, options);
+    if (options.output.empty()) {
+        std::cout << text;
+    } else {
+        std::ofstream file(options.output);
+        file << text;
+        if (!file) {
+            std::fprintf(stderr, "Benchmarks: cannot write %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
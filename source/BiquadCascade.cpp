@@ -0,0 +1,180 @@
+#include "BiquadCascade.h"
+
+#include <algorithm>
+#include <cmath>
+
+BiquadCascade::Coefficients BiquadCascade::fromArray(const std::array<float, 6>& c) noexcept
+{
+    const float a0 = c[3];
+    return { c[0] / a0, c[1] / a0, c[2] / a0, c[4] / a0, c[5] / a0 };
+}
+
+bool BiquadCascade::isFlat(const Coefficients& c) noexcept
+{
+    // H(z) == 1 whenever the numerator equals the denominator
+    constexpr float tolerance = 1.0e-6f;
+    return std::abs(c[0] - 1.0f) < tolerance
+        && std::abs(c[1] - c[3]) < tolerance
+        && std::abs(c[2] - c[4]) < tolerance;
+}
+
+void BiquadCascade::prepare(int numChannels, int numSections)
+{
+    numPreparedChannels = std::max(1, numChannels);
+    numPreparedSections = std::clamp(numSections, 0, maxSections);
+
+    groups.clear();
+    for (const auto& layout : LaneLayout::split(numPreparedChannels)) {
+        LaneGroup group;
+        group.firstChannel = layout.firstChannel;
+        group.numLanes = layout.numLanes;
+        group.s1.assign((size_t) maxSections * (size_t) layout.numLanes, 0.0f);
+        group.s2.assign((size_t) maxSections * (size_t) layout.numLanes, 0.0f);
+        groups.push_back(std::move(group));
+    }
+
+    // Sections start flat until their coefficients are set
+    for (auto& section : sections)
+        section = Section { { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f }, {}, { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f }, 0, false };
+
+    numActiveSections = 0;
+}
+
+void BiquadCascade::reset()
+{
+    for (auto& group : groups) {
+        std::fill(group.s1.begin(), group.s1.end(), 0.0f);
+        std::fill(group.s2.begin(), group.s2.end(), 0.0f);
+    }
+}
+
+void BiquadCascade::setCoefficients(int index, const Coefficients& coefficients, int rampSamples) noexcept
+{
+    if (index < 0 || index >= numPreparedSections)
+        return;
+
+    auto& section = sections[(size_t) index];
+    section.target = coefficients;
+
+    if (rampSamples > 0 && section.current != coefficients) {
+        for (size_t c = 0; c < coefficients.size(); ++c)
+            section.increment[c] = (coefficients[c] - section.current[c]) / (float) rampSamples;
+        section.rampRemaining = rampSamples;
+    } else {
+        section.current = coefficients;
+        section.increment = {};
+        section.rampRemaining = 0;
+    }
+
+    // A section that goes flat drops its state, so it restarts cleanly when it comes back
+    const bool wasActive = section.active;
+    section.active = section.rampRemaining > 0 || !isFlat(section.current);
+    if (wasActive && !section.active) {
+        for (auto& group : groups) {
+            std::fill_n(group.s1.begin() + index * group.numLanes, group.numLanes, 0.0f);
+            std::fill_n(group.s2.begin() + index * group.numLanes, group.numLanes, 0.0f);
+        }
+    }
+
+    numActiveSections = 0;
+    for (int s = 0; s < numPreparedSections; ++s)
+        if (sections[(size_t) s].active)
+            activeSections[(size_t) numActiveSections++] = s;
+}
+
+void BiquadCascade::takeSnapshot(int groupIndex, Snapshot& snapshot) noexcept
+{
+    auto& group = groups[(size_t) groupIndex];
+
+    snapshot.numSections = numActiveSections;
+    for (int a = 0; a < numActiveSections; ++a) {
+        const int s = activeSections[(size_t) a];
+        const auto& section = sections[(size_t) s];
+
+        std::copy(section.current.begin(), section.current.end(), snapshot.current[a]);
+        std::copy(section.increment.begin(), section.increment.end(), snapshot.increment[a]);
+        snapshot.rampRemaining[a] = section.rampRemaining;
+        snapshot.s1[a] = group.s1.data() + s * group.numLanes;
+        snapshot.s2[a] = group.s2.data() + s * group.numLanes;
+    }
+}
+
+template <int numLanes>
+void BiquadCascade::processGroup(int groupIndex, float* const* channels, int numChannels, int numSamples) noexcept
+{
+    float* const* data = channels + groups[(size_t) groupIndex].firstChannel;
+    GroupRunner<numLanes> runner(*this, groupIndex);
+
+    for (int i = 0; i < numSamples; ++i) {
+        float x[(size_t) numLanes] {};
+        for (int l = 0; l < numChannels; ++l)
+            x[l] = data[l][i];
+
+        runner.processSample(x, i);
+
+        for (int l = 0; l < numChannels; ++l)
+            data[l][i] = x[l];
+    }
+}
+
+void BiquadCascade::process(float* const* channels, int numChannels, int numSamples) noexcept
+{
+    if (numActiveSections == 0)
+        return;
+
+    numChannels = std::min(numChannels, numPreparedChannels);
+
+    for (int g = 0; g < (int) groups.size(); ++g) {
+        const auto& group = groups[(size_t) g];
+        if (group.firstChannel >= numChannels)
+            break;
+
+        // A group only partly covered by the buffer runs its missing lanes on silence
+        const int groupChannels = std::min(group.numLanes, numChannels - group.firstChannel);
+
+        switch (group.numLanes) {
+            case 8:
+                processGroup<8>(g, channels, groupChannels, numSamples);
+                break;
+            case 4:
+                processGroup<4>(g, channels, groupChannels, numSamples);
+                break;
+            case 2:
+                processGroup<2>(g, channels, groupChannels, numSamples);
+                break;
+            default:
+                processGroup<1>(g, channels, groupChannels, numSamples);
+                break;
+        }
+    }
+
+    advance(numSamples);
+}
+
+void BiquadCascade::advance(int numSamples) noexcept
+{
+    // Advance the glides now that every group has consumed this block
+    bool rampFinished = false;
+    for (int a = 0; a < numActiveSections; ++a) {
+        auto& section = sections[(size_t) activeSections[(size_t) a]];
+        if (section.rampRemaining == 0)
+            continue;
+
+        const int steps = std::min(numSamples, section.rampRemaining);
+        section.rampRemaining -= steps;
+        if (section.rampRemaining == 0) {
+            section.current = section.target;
+            section.increment = {};
+            rampFinished = true;
+        } else {
+            for (size_t n = 0; n < section.current.size(); ++n)
+                section.current[n] += section.increment[n] * (float) steps;
+        }
+    }
+
+    // A glide that ended on a flat response lets the section drop out
+    if (rampFinished)
+        for (int s = 0; s < numPreparedSections; ++s)
+            if (sections[(size_t) s].active && sections[(size_t) s].rampRemaining == 0)
+                setCoefficients(s, sections[(size_t) s].current);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "LaneLayout.h"
+#include <array>
+#include <cstddef>
+
+// Cascade of transposed direct form II biquads run in a single pass per sample:
+// every section is applied while the sample is still in registers, and channels
+// are interleaved across SIMD lanes like RT_LSTM. Sections whose response is flat
+// (e.g. a peak filter at unity gain) are skipped entirely.
+class BiquadCascade
+{
+public:
+    static constexpr int maxSections = 4;
+    static constexpr int numCoefficients = 5;
+
+    // b0, b1, b2, a1, a2, normalised so that a0 == 1
+    using Coefficients = std::array<float, numCoefficients>;
+
+    // Normalises the { b0, b1, b2, a0, a1, a2 } arrays returned by juce::dsp::IIR::ArrayCoefficients
+    static Coefficients fromArray(const std::array<float, 6>& c) noexcept;
+
+    void prepare(int numChannels, int numSections);
+    void reset();
+
+    // Sets a section's target response. With rampSamples > 0 the coefficients glide
+    // linearly, sample by sample, over the next rampSamples processed samples.
+    void setCoefficients(int section, const Coefficients& coefficients, int rampSamples = 0) noexcept;
+
+    // Fewer channels than prepared are fine: lanes left without one run on silence. Channels
+    // past the prepared count are not touched.
+    void process(float* const* channels, int numChannels, int numSamples) noexcept;
+
+    int getNumChannels() const noexcept { return numPreparedChannels; }
+    int getNumGroups() const noexcept { return (int) groups.size(); }
+    const LaneLayout::Group& getGroup(int groupIndex) const noexcept { return groups[(size_t) groupIndex]; }
+
+    // The active sections of one lane group as plain arrays, copied out at the start of a block
+    struct Snapshot
+    {
+        int numSections;
+        float current[maxSections][numCoefficients];
+        float increment[maxSections][numCoefficients];
+        int rampRemaining[maxSections];
+        float* s1[maxSections]; // the group's lane-interleaved state for each section
+        float* s2[maxSections];
+    };
+
+    void takeSnapshot(int groupIndex, Snapshot& snapshot) noexcept;
+
+    // Runs the cascade on one lane group a sample at a time, for callers that produce
+    // samples one by one (RT_LSTM's fused output). The group's filter state is held in
+    // the runner and written back when it goes out of scope. Once every group has been
+    // run over a block, close it with advance(). Target only tells apart the copies built
+    // by each ISA-specific kernel (see LSTMKernels.h), so the linker never mixes them; for
+    // the same reason the runner only touches its Snapshot, never std:: containers.
+    template <int numLanes, typename Target = void>
+    class GroupRunner
+    {
+    public:
+        GroupRunner(BiquadCascade& cascade, int groupIndex) noexcept;
+        ~GroupRunner() noexcept;
+
+        // x holds one sample per lane; sampleIndex is relative to the start of the block
+        void processSample(float* x, int sampleIndex) noexcept;
+
+    private:
+        Snapshot snapshot;
+        float s1[maxSections][(size_t) numLanes];
+        float s2[maxSections][(size_t) numLanes];
+    };
+
+    // Advances the coefficient glides past a block processed with GroupRunners
+    void advance(int numSamples) noexcept;
+
+private:
+    struct Section
+    {
+        Coefficients current {};   // coefficients at the start of the next block
+        Coefficients increment {}; // per-sample glide
+        Coefficients target {};
+        int rampRemaining = 0;
+        bool active = false;       // false while the section is flat and not gliding
+    };
+
+    struct LaneGroup : LaneLayout::Group
+    {
+        // s1/s2 per section, lane-interleaved: [section * numLanes + lane]
+        std::vector<float> s1;
+        std::vector<float> s2;
+    };
+
+    static bool isFlat(const Coefficients& c) noexcept;
+
+    template <int numLanes>
+    void processGroup(int groupIndex, float* const* channels, int numChannels, int numSamples) noexcept;
+
+    std::array<Section, maxSections> sections;
+    int numActiveSections = 0;
+    std::array<int, maxSections> activeSections {};
+
+    std::vector<LaneGroup> groups;
+    int numPreparedChannels = 0;
+    int numPreparedSections = 0;
+};
+
+template <int numLanes, typename Target>
+BiquadCascade::GroupRunner<numLanes, Target>::GroupRunner(BiquadCascade& cascade, int groupIndex) noexcept
+{
+    cascade.takeSnapshot(groupIndex, snapshot);
+
+    // Keep the filter state in locals for the whole block
+    for (int a = 0; a < snapshot.numSections; ++a) {
+        for (int l = 0; l < numLanes; ++l) {
+            s1[a][l] = snapshot.s1[a][l];
+            s2[a][l] = snapshot.s2[a][l];
+        }
+    }
+}
+
+template <int numLanes, typename Target>
+BiquadCascade::GroupRunner<numLanes, Target>::~GroupRunner() noexcept
+{
+    for (int a = 0; a < snapshot.numSections; ++a) {
+        for (int l = 0; l < numLanes; ++l) {
+            snapshot.s1[a][l] = s1[a][l];
+            snapshot.s2[a][l] = s2[a][l];
+        }
+    }
+}
+
+template <int numLanes, typename Target>
+inline void BiquadCascade::GroupRunner<numLanes, Target>::processSample(float* x, int sampleIndex) noexcept
+{
+    for (int a = 0; a < snapshot.numSections; ++a) {
+        float c[numCoefficients];
+        for (int n = 0; n < numCoefficients; ++n)
+            c[n] = snapshot.current[a][n];
+
+        const int rampRemaining = snapshot.rampRemaining[a];
+        if (rampRemaining > 0) {
+            const float steps = (float) (sampleIndex < rampRemaining ? sampleIndex + 1 : rampRemaining);
+            for (int n = 0; n < numCoefficients; ++n)
+                c[n] += snapshot.increment[a][n] * steps;
+        }
+
+        for (int l = 0; l < numLanes; ++l) {
+            const float y = c[0] * x[l] + s1[a][l];
+            s1[a][l] = c[1] * x[l] - c[3] * y + s2[a][l];
+            s2[a][l] = c[2] * x[l] - c[4] * y;
+            x[l] = y;
+        }
+    }
+}
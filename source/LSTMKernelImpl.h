@@ -0,0 +1,324 @@
+// Body of the recurrent kernels, included once by each LSTMKernels*.cpp after defining
+// LSTM_KERNEL_NAMESPACE. Everything below lives in that namespace (or is instantiated
+// with its Target tag) so that copies compiled with different ISA flags never meet at link
+// time. Only call C math functions here: inline std:: wrappers would be shared between them.
+
+#include "LSTMKernels.h"
+#include <math.h>
+#include <string.h>
+
+namespace LSTMKernels::LSTM_KERNEL_NAMESPACE
+{
+    struct Target
+    {
+    };
+
+    using Precision = LSTMWeights::Precision;
+    using UnitType = LSTMWeights::UnitType;
+
+    template <UnitType unit, int hiddenSize>
+    constexpr int gatesSizeFor = ModelBlob::gatesPerUnit(unit) * hiddenSize;
+
+    static inline float sigmoid(float x) noexcept
+    {
+        return 1.0f / (1.0f + expf(-x));
+    }
+
+    // Eco mode: odd 13/6 rational fit of tanh (the same one Eigen uses), branch-free
+    // so the gate loop vectorises instead of calling into libm per element
+    static inline float fastTanh(float x) noexcept
+    {
+        constexpr float clamp = 7.90531110763549805f;
+        x = x > clamp ? clamp : (x < -clamp ? -clamp : x);
+
+        const float x2 = x * x;
+        float p = -2.76076847742355e-16f;
+        p = p * x2 + 2.00018790482477e-13f;
+        p = p * x2 - 8.60467152213735e-11f;
+        p = p * x2 + 5.12229709037114e-08f;
+        p = p * x2 + 1.48572235717979e-05f;
+        p = p * x2 + 6.37261928875436e-04f;
+        p = p * x2 + 4.89352455891786e-03f;
+
+        float q = 1.19825839466702e-06f;
+        q = q * x2 + 1.18534705686654e-04f;
+        q = q * x2 + 2.26843463243900e-03f;
+        q = q * x2 + 4.89352518554385e-03f;
+
+        return x * p / q;
+    }
+
+    static inline float fastSigmoid(float x) noexcept
+    {
+        return 0.5f + 0.5f * fastTanh(0.5f * x);
+    }
+
+    template <bool eco>
+    static inline float activateSigmoid(float x) noexcept
+    {
+        if constexpr (eco)
+            return fastSigmoid(x);
+        else
+            return sigmoid(x);
+    }
+
+    template <bool eco>
+    static inline float activateTanh(float x) noexcept
+    {
+        if constexpr (eco)
+            return fastTanh(x);
+        else
+            return tanhf(x);
+    }
+
+    // Half bits shifted into a float's mantissa; the exponent is off by 2^-112, which
+    // halfScale puts back. Finite values only (all that ModelBlob::fromJson packs).
+    static inline float halfBits(uint16_t h) noexcept
+    {
+        const uint32_t bits = ((uint32_t) (h & 0x8000u) << 16) | ((uint32_t) (h & 0x7fffu) << 13);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // y[k][lane] += sum_j W[j][k] * x[j][lane], each weight loaded once for every lane
+    template <int rows, int gatesSize, int numLanes, Precision precision>
+    static inline void addMatVec(const LSTMWeights::Matrix& m, const float* x, float* y) noexcept
+    {
+        if constexpr (precision == Precision::Float32) {
+            for (int j = 0; j < rows; ++j) {
+                float h[(size_t) numLanes];
+                for (int l = 0; l < numLanes; ++l)
+                    h[l] = x[j * numLanes + l];
+
+                const float* w = m.values + j * gatesSize;
+                for (int k = 0; k < gatesSize; ++k)
+                    for (int l = 0; l < numLanes; ++l)
+                        y[k * numLanes + l] += w[k] * h[l];
+            }
+        } else {
+            // Unscaled dot products in float, then one multiply per gate row
+            float acc[(size_t) (gatesSize * numLanes)] = {};
+            for (int j = 0; j < rows; ++j) {
+                float h[(size_t) numLanes];
+                for (int l = 0; l < numLanes; ++l)
+                    h[l] = x[j * numLanes + l];
+
+                for (int k = 0; k < gatesSize; ++k) {
+                    float q;
+                    if constexpr (precision == Precision::Int8)
+                        q = (float) m.int8Values[j * gatesSize + k];
+                    else
+                        q = halfBits(m.halfValues[j * gatesSize + k]);
+
+                    for (int l = 0; l < numLanes; ++l)
+                        acc[k * numLanes + l] += q * h[l];
+                }
+            }
+
+            const float* scale = precision == Precision::Int8 ? m.int8Scale : m.halfScale;
+            for (int k = 0; k < gatesSize; ++k)
+                for (int l = 0; l < numLanes; ++l)
+                    y[k * numLanes + l] += scale[k] * acc[k * numLanes + l];
+        }
+    }
+
+    // Computes the first layer's W_ih * x + b for numRows samples from args.offset + first
+    // into inputGates. With rampDrive == false the drive input comes from the folded bias and
+    // only the audio column is used.
+    template <int gatesSize, int numLanes, bool rampDrive>
+    static void projectInputs(const GroupArgs& args, int first, int numRows, float* inputGates) noexcept
+    {
+        const auto& w = *args.weights;
+        const float* wAudio = w.wAudio();
+        const float* wDrive = w.wDrive();
+        const float* bias = w.layers[0].bias;
+
+        // Rank-1 (or rank-2 while ramping) product of the block with W_ih, plus bias
+        for (int i = 0; i < numRows; ++i) {
+            float* gates = inputGates + (size_t) i * gatesSize * numLanes;
+            const int n = args.offset + first + i;
+
+            float input[(size_t) numLanes] {};
+            for (int l = 0; l < args.numChannels; ++l)
+                input[l] = args.inData[l][n];
+
+            if constexpr (rampDrive) {
+                const float drive = args.previousDrive + (float) (n + 1) * args.steppedValue;
+                for (int k = 0; k < gatesSize; ++k) {
+                    const float b = bias[k] + wDrive[k] * drive;
+                    for (int l = 0; l < numLanes; ++l)
+                        gates[k * numLanes + l] = b + wAudio[k] * input[l];
+                }
+            } else {
+                for (int k = 0; k < gatesSize; ++k)
+                    for (int l = 0; l < numLanes; ++l)
+                        gates[k * numLanes + l] = args.foldedBias[k] + wAudio[k] * input[l];
+            }
+        }
+    }
+
+    // One step of a layer whose input projection (plus bias) is already in gates
+    template <UnitType unit, int hiddenSize, int numLanes, bool eco, Precision precision>
+    static inline void stepLayer(const LSTMWeights::Layer& layer, float* hidden, float* cell, float* gates) noexcept
+    {
+        constexpr int gatesSize = gatesSizeFor<unit, hiddenSize>;
+        constexpr int unitLanes = hiddenSize * numLanes;
+
+        if constexpr (unit == UnitType::LSTM) {
+            addMatVec<hiddenSize, gatesSize, numLanes, precision>(layer.recurrent, hidden, gates);
+
+            // Gates and state update, one flat run over every unit of every lane
+            for (int n = 0; n < unitLanes; ++n) {
+                const float i = activateSigmoid<eco>(gates[n]);
+                const float f = activateSigmoid<eco>(gates[unitLanes + n]);
+                const float g = activateTanh<eco>(gates[2 * unitLanes + n]);
+                const float o = activateSigmoid<eco>(gates[3 * unitLanes + n]);
+
+                cell[n] = f * cell[n] + i * g;
+                hidden[n] = o * activateTanh<eco>(cell[n]);
+            }
+        } else {
+            // GRU: the candidate's recurrent part is gated by r, so it is kept apart
+            float recurrent[(size_t) (gatesSize * numLanes)] = {};
+            addMatVec<hiddenSize, gatesSize, numLanes, precision>(layer.recurrent, hidden, recurrent);
+
+            for (int j = 0; j < hiddenSize; ++j) {
+                for (int l = 0; l < numLanes; ++l) {
+                    const int n = j * numLanes + l;
+                    const float r = activateSigmoid<eco>(gates[n] + recurrent[n]);
+                    const float z = activateSigmoid<eco>(gates[unitLanes + n] + recurrent[unitLanes + n]);
+                    const float c = activateTanh<eco>(gates[2 * unitLanes + n] + r * (recurrent[2 * unitLanes + n] + layer.recurrentBias[j]));
+
+                    hidden[n] = c + z * (hidden[n] - c);
+                }
+            }
+        }
+    }
+
+    // Runs every layer and the Dense head on a projected row of input gates
+    template <UnitType unit, int hiddenSize, int numLanes, bool eco, Precision precision>
+    static inline void step(const GroupArgs& args, float* gates, float* out) noexcept
+    {
+        constexpr int gatesSize = gatesSizeFor<unit, hiddenSize>;
+        const auto& w = *args.weights;
+
+        stepLayer<unit, hiddenSize, numLanes, eco, precision>(w.layers[0], args.hidden[0], args.cell[0], gates);
+
+        const float* last = args.hidden[0];
+        if (w.numLayers > 1) {
+            const auto& layer = w.layers[1];
+
+            float upperGates[(size_t) (gatesSize * numLanes)];
+            for (int k = 0; k < gatesSize; ++k)
+                for (int l = 0; l < numLanes; ++l)
+                    upperGates[k * numLanes + l] = layer.bias[k];
+
+            addMatVec<hiddenSize, gatesSize, numLanes, precision>(layer.input, args.hidden[0], upperGates);
+            stepLayer<unit, hiddenSize, numLanes, eco, precision>(layer, args.hidden[1], args.cell[1], upperGates);
+            last = args.hidden[1];
+        }
+
+        // Dense head
+        for (int l = 0; l < numLanes; ++l)
+            out[l] = w.denseBias;
+
+        for (int j = 0; j < hiddenSize; ++j)
+            for (int l = 0; l < numLanes; ++l)
+                out[l] += w.denseWeights[j] * last[j * numLanes + l];
+    }
+
+    // Projects the chunk a sub-block at a time into a stack buffer that stays in L1, and hands
+    // each sample's model output, with its index, to emit
+    template <UnitType unit, int hiddenSize, int numLanes, bool eco, Precision precision, typename Emit>
+    static inline void runChunk(const GroupArgs& args, Emit&& emit) noexcept
+    {
+        constexpr int gatesSize = gatesSizeFor<unit, hiddenSize>;
+        constexpr int rows = projectionRows(gatesSize, numLanes);
+        alignas(64) float inputGates[(size_t) (rows * gatesSize * numLanes)];
+
+        for (int first = 0; first < args.numSamples; first += rows) {
+            const int numRows = args.numSamples - first < rows ? args.numSamples - first : rows;
+
+            // Perform ramped value calculations to smooth out sound
+            if (args.rampDrive)
+                projectInputs<gatesSize, numLanes, true>(args, first, numRows, inputGates);
+            else
+                projectInputs<gatesSize, numLanes, false>(args, first, numRows, inputGates);
+
+            for (int i = 0; i < numRows; ++i) {
+                float out[(size_t) numLanes];
+                step<unit, hiddenSize, numLanes, eco, precision>(args, inputGates + (size_t) i * gatesSize * numLanes, out);
+                emit(out, args.offset + first + i);
+            }
+        }
+    }
+
+    template <UnitType unit, int hiddenSize, int numLanes, bool eco, Precision precision>
+    static void processGroup(const GroupArgs& args) noexcept
+    {
+        const float* const* in = args.inData;
+        float* const* outs = args.outData;
+        const float skip = args.weights->skipGain;
+        const int numChannels = args.numChannels;
+
+        if (args.outputStage == nullptr) {
+            runChunk<unit, hiddenSize, numLanes, eco, precision>(args, [&](float* out, int n) {
+                for (int l = 0; l < numChannels; ++l)
+                    outs[l][n] = out[l] + skip * in[l][n];
+            });
+            return;
+        }
+
+        // Fused output: skip connection, tone and gain while the sample is in registers
+        OutputStage::GroupRunner<numLanes, Target> post(*args.outputStage, args.groupIndex);
+
+        runChunk<unit, hiddenSize, numLanes, eco, precision>(args, [&](float* out, int n) {
+            for (int l = 0; l < numChannels; ++l)
+                out[l] += skip * in[l][n];
+
+            post.processSample(out, n);
+
+            for (int l = 0; l < numChannels; ++l)
+                outs[l][n] = out[l];
+        });
+    }
+
+    // Dispatch table, filled at compile time
+    template <UnitType unit, int hiddenSize, bool eco, Precision precision>
+    static constexpr void fillLanes(GroupKernel (&lanes)[4]) noexcept
+    {
+        lanes[0] = &processGroup<unit, hiddenSize, 1, eco, precision>;
+        lanes[1] = &processGroup<unit, hiddenSize, 2, eco, precision>;
+        lanes[2] = &processGroup<unit, hiddenSize, 4, eco, precision>;
+        lanes[3] = &processGroup<unit, hiddenSize, 8, eco, precision>;
+    }
+
+    template <UnitType unit, int sizeIndex>
+    static constexpr void fillArchitecture(Kernel& kernel) noexcept
+    {
+        constexpr int hiddenSize = hiddenSizes[sizeIndex];
+        auto& groups = kernel.architectures[(int) unit][sizeIndex].groups;
+
+        fillLanes<unit, hiddenSize, false, Precision::Float32>(groups[0][0]);
+        fillLanes<unit, hiddenSize, true, Precision::Float32>(groups[0][1]);
+        fillLanes<unit, hiddenSize, false, Precision::Float16>(groups[1][0]);
+        fillLanes<unit, hiddenSize, true, Precision::Float16>(groups[1][1]);
+        fillLanes<unit, hiddenSize, false, Precision::Int8>(groups[2][0]);
+        fillLanes<unit, hiddenSize, true, Precision::Int8>(groups[2][1]);
+
+        if constexpr (sizeIndex + 1 < numHiddenSizes)
+            fillArchitecture<unit, sizeIndex + 1>(kernel);
+    }
+
+    static constexpr Kernel makeKernel() noexcept
+    {
+        Kernel kernel { LSTM_KERNEL_VARIANT, LSTM_KERNEL_NAME, {} };
+        fillArchitecture<UnitType::LSTM, 0>(kernel);
+        fillArchitecture<UnitType::GRU, 0>(kernel);
+        return kernel;
+    }
+
+    extern const Kernel kernel;
+    constexpr Kernel kernel = makeKernel();
+}
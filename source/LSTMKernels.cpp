@@ -0,0 +1,132 @@
+#include "LSTMKernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <immintrin.h>
+    #include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define LSTM_KERNELS_X64 1
+#else
+    #define LSTM_KERNELS_X64 0
+#endif
+
+namespace LSTMKernels
+{
+    namespace baseline
+    {
+        extern const Kernel kernel;
+    }
+
+#if LSTM_KERNELS_X64
+    namespace avx2
+    {
+        extern const Kernel kernel;
+    }
+
+    namespace avx512
+    {
+        extern const Kernel kernel;
+    }
+#endif
+
+    struct CpuFeatures
+    {
+        bool avx2 = false;
+        bool avx512 = false;
+    };
+
+    static CpuFeatures detectCpu() noexcept
+    {
+        CpuFeatures features;
+
+#if LSTM_KERNELS_X64 && defined(_MSC_VER)
+        int info[4] {};
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        if (maxLeaf < 7)
+            return features;
+
+        __cpuid(info, 1);
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave)
+            return features;
+
+        // The OS must save the YMM (and for AVX-512, opmask and ZMM) registers too
+        const auto xcr0 = _xgetbv(0);
+        const bool osAvx = (xcr0 & 0x06) == 0x06;
+        const bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+        __cpuidex(info, 7, 0);
+        const bool avx2 = (info[1] & (1 << 5)) != 0;
+        const bool avx512f = (info[1] & (1 << 16)) != 0;
+        const bool avx512dq = (info[1] & (1 << 17)) != 0;
+        const bool avx512bw = (info[1] & (1 << 30)) != 0;
+        const bool avx512vl = (info[1] & (1 << 31)) != 0;
+
+        features.avx2 = osAvx && avx2 && fma;
+        features.avx512 = features.avx2 && osAvx512 && avx512f && avx512dq && avx512bw && avx512vl;
+#elif LSTM_KERNELS_X64 && (defined(__GNUC__) || defined(__clang__))
+        // Also checks that the OS saves the extended registers
+        __builtin_cpu_init();
+        features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        features.avx512 = features.avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+                          && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+#endif
+
+        return features;
+    }
+
+    const Kernel* get(Variant variant) noexcept
+    {
+        static const CpuFeatures cpu = detectCpu();
+
+        switch (variant) {
+            case Variant::Baseline:
+                return &baseline::kernel;
+#if LSTM_KERNELS_X64
+            case Variant::AVX2:
+                return cpu.avx2 ? &avx2::kernel : nullptr;
+            case Variant::AVX512:
+                return cpu.avx512 ? &avx512::kernel : nullptr;
+#endif
+            default:
+                return nullptr;
+        }
+    }
+
+    const Kernel* find(const char* name) noexcept
+    {
+        if (name == nullptr)
+            return nullptr;
+
+        if (std::strcmp(name, "baseline") == 0)
+            return get(Variant::Baseline);
+
+        for (auto variant : { Variant::Baseline, Variant::AVX2, Variant::AVX512 })
+            if (const auto* kernel = get(variant); kernel != nullptr && std::strcmp(name, kernel->name) == 0)
+                return kernel;
+
+        return nullptr;
+    }
+
+    const Kernel& best() noexcept
+    {
+        static const Kernel& chosen = [] () -> const Kernel& {
+            if (const auto* forced = find(std::getenv("PUNKDIST_KERNEL")))
+                return *forced;
+
+            for (auto variant : { Variant::AVX512, Variant::AVX2 })
+                if (const auto* kernel = get(variant))
+                    return *kernel;
+
+            return baseline::kernel;
+        }();
+
+        return chosen;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "LSTMWeights.h"
+#include "OutputStage.h"
+
+// The per-sample recurrent + Dense kernels are compiled several times, once per instruction
+// set (LSTMKernelImpl.h included from each LSTMKernels*.cpp with its own compiler flags),
+// and RT_LSTM picks one when it is created. A single binary therefore uses AVX2 or
+// AVX-512 where the CPU has them and still runs on a baseline x86-64 or arm64 machine.
+//
+// Within each instruction set there is a fully specialised kernel for every supported
+// architecture (unit type and hidden size as template arguments, so every loop has a
+// compile-time trip count), chosen from the model header when the weights are loaded.
+namespace LSTMKernels
+{
+    enum class Variant
+    {
+        Baseline = 0, // SSE2 on x86-64, NEON on arm64, plain C++ elsewhere
+        AVX2,         // AVX2 + FMA
+        AVX512        // AVX-512F/VL/DQ/BW
+    };
+
+    // Hidden sizes with a specialised kernel, for both LSTM and GRU and one or two layers
+    constexpr int hiddenSizes[] = { 8, 16, 24, 32, 48, 64 };
+    constexpr int numHiddenSizes = (int) (sizeof(hiddenSizes) / sizeof(hiddenSizes[0]));
+
+    constexpr int hiddenSizeIndex(int hiddenSize) noexcept
+    {
+        for (int i = 0; i < numHiddenSizes; ++i)
+            if (hiddenSizes[i] == hiddenSize)
+                return i;
+        return -1;
+    }
+
+    constexpr bool supports(LSTMWeights::UnitType unitType, int hiddenSize, int numLayers) noexcept
+    {
+        return (unitType == LSTMWeights::UnitType::LSTM || unitType == LSTMWeights::UnitType::GRU)
+               && hiddenSizeIndex(hiddenSize) >= 0 && numLayers >= 1 && numLayers <= LSTMWeights::maxLayers;
+    }
+
+    // The first layer's input projection runs ahead of the recurrence in sub-blocks of up to
+    // this many floats on the kernel's stack, so its rows are still in L1 when the recurrence
+    // reads them. Kept within 4 KB: rows exactly 4 KB apart made the loads of one wait on the
+    // stores of the other (4K aliasing) and ran stereo at a quarter of the speed.
+    constexpr int projectionFloats = 1024;
+
+    // Samples per projection sub-block for a lane group; at least one
+    constexpr int projectionRows(int gatesSize, int numLanes) noexcept
+    {
+        return gatesSize * numLanes >= projectionFloats ? 1 : projectionFloats / (gatesSize * numLanes);
+    }
+
+    // Everything one lane group needs to run a chunk of samples
+    struct GroupArgs
+    {
+        const LSTMWeights* weights = nullptr;
+        const float* foldedBias = nullptr; // first layer bias with a steady drive folded in
+        float* hidden[LSTMWeights::maxLayers] {}; // lane-interleaved state: [j * numLanes + lane]
+        float* cell[LSTMWeights::maxLayers] {};   // LSTM only
+        const float* const* inData = nullptr; // first channel of the group
+        float* const* outData = nullptr;
+        int numChannels = 0; // of the group's lanes, how many have a channel; the rest run on silence and are not stored
+        int offset = 0;
+        int numSamples = 0;
+        // While ramping, sample offset + i runs at previousDrive + (offset + i + 1) * steppedValue
+        bool rampDrive = false;
+        float previousDrive = 0.0f;
+        float steppedValue = 0.0f;
+        OutputStage* outputStage = nullptr; // fused output, or nullptr for model(x) + x
+        int groupIndex = 0;
+    };
+
+    using GroupKernel = void (*)(const GroupArgs&) noexcept;
+
+    // [weight precision][exact, eco activations][1, 2, 4 and 8 lanes]
+    struct ArchitectureKernels
+    {
+        GroupKernel groups[3][2][4];
+    };
+
+    struct Kernel
+    {
+        Variant variant;
+        const char* name;
+        ArchitectureKernels architectures[2][numHiddenSizes]; // [LSTM, GRU][hidden size]
+
+        // nullptr for an architecture without a specialisation
+        GroupKernel find(LSTMWeights::UnitType unitType, int hiddenSize, int numLanes, bool eco = false,
+                         LSTMWeights::Precision precision = LSTMWeights::Precision::Float32) const noexcept
+        {
+            const int sizeIndex = hiddenSizeIndex(hiddenSize);
+            if (sizeIndex < 0 || (int) unitType > 1)
+                return nullptr;
+
+            const int laneIndex = numLanes >= 8 ? 3 : numLanes >= 4 ? 2 : numLanes >= 2 ? 1 : 0;
+            return architectures[(int) unitType][sizeIndex].groups[(int) precision][eco ? 1 : 0][laneIndex];
+        }
+    };
+
+    // The kernel built for a variant, or nullptr if it was not compiled in or this CPU
+    // cannot run it
+    const Kernel* get(Variant variant) noexcept;
+
+    // Looks a variant up by name ("sse2", "neon", "avx2", "avx512" or "baseline")
+    const Kernel* find(const char* name) noexcept;
+
+    // The fastest kernel this CPU supports. Setting the PUNKDIST_KERNEL environment
+    // variable to a variant name forces that one instead, if it can run.
+    const Kernel& best() noexcept;
+}
@@ -0,0 +1,9 @@
+// AVX2 + FMA LSTM kernels. CMakeLists.txt compiles this file alone with those flags;
+// RT_LSTM only calls into it once CPUID says the machine supports them.
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define LSTM_KERNEL_NAME "avx2"
+    #define LSTM_KERNEL_NAMESPACE avx2
+    #define LSTM_KERNEL_VARIANT Variant::AVX2
+    #include "LSTMKernelImpl.h"
+#endif
@@ -0,0 +1,9 @@
+// AVX-512 LSTM kernels. CMakeLists.txt compiles this file alone with those flags;
+// RT_LSTM only calls into it once CPUID says the machine supports them.
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define LSTM_KERNEL_NAME "avx512"
+    #define LSTM_KERNEL_NAMESPACE avx512
+    #define LSTM_KERNEL_VARIANT Variant::AVX512
+    #include "LSTMKernelImpl.h"
+#endif
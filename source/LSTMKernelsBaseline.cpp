@@ -0,0 +1,13 @@
+// Baseline LSTM kernels, built with the project's default flags
+
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+    #define LSTM_KERNEL_NAME "neon"
+#elif defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define LSTM_KERNEL_NAME "sse2"
+#else
+    #define LSTM_KERNEL_NAME "baseline"
+#endif
+
+#define LSTM_KERNEL_NAMESPACE baseline
+#define LSTM_KERNEL_VARIANT Variant::Baseline
+#include "LSTMKernelImpl.h"
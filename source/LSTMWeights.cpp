@@ -0,0 +1,96 @@
+#include "LSTMWeights.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+const float* LSTMWeights::wAudio() const noexcept
+{
+    return layers[0].input.values;
+}
+
+const float* LSTMWeights::wDrive() const noexcept
+{
+    return layers[0].input.values + gatesSize;
+}
+
+std::shared_ptr<const LSTMWeights> LSTMWeights::fromBinary(const void* data, size_t size)
+{
+    ModelBlob::Header header;
+    const unsigned char* payload = nullptr;
+    if (!ModelBlob::parse(data, size, header, payload))
+        return nullptr;
+
+    if (header.inputSize != 2 || header.outputSize != 1)
+        return nullptr;
+
+    // Weak references, so the weights are freed once the last RT_LSTM lets go. The
+    // checksum only narrows the search: a hit must match the header and payload byte
+    // for byte, since FNV-1a is easy to collide.
+    struct StoreEntry
+    {
+        ModelBlob::Header header;
+        std::weak_ptr<const LSTMWeights> weights;
+    };
+
+    static std::mutex storeMutex;
+    static std::multimap<uint32_t, StoreEntry> store;
+
+    const std::lock_guard<std::mutex> lock(storeMutex);
+
+    std::erase_if(store, [](const auto& entry) { return entry.second.weights.expired(); });
+
+    const auto [first, last] = store.equal_range(header.checksum);
+    for (auto it = first; it != last; ++it) {
+        auto shared = it->second.weights.lock();
+        if (shared != nullptr
+            && std::memcmp(&it->second.header, &header, sizeof(header)) == 0
+            && shared->payloadData.size() * sizeof(float) == header.payloadSize
+            && std::memcmp(shared->payloadData.data(), payload, header.payloadSize) == 0)
+            return shared;
+    }
+
+    auto weights = std::make_shared<LSTMWeights>();
+    if (header.sampleRate != 0)
+        weights->sampleRate = (double) header.sampleRate;
+
+    weights->skipGain = (header.flags & ModelBlob::noSkip) != 0 ? 0.0f : 1.0f;
+    weights->unitType = (UnitType) header.unitType;
+    weights->hiddenSize = (int) header.hiddenSize;
+    weights->gatesSize = ModelBlob::gatesPerUnit(weights->unitType) * weights->hiddenSize;
+    weights->numLayers = (int) header.numLayers;
+
+    // The sections are already padded, transposed and quantised; keep them as they are.
+    // Held as floats so every section is at least float aligned.
+    weights->payloadData.resize(header.payloadSize / sizeof(float));
+    std::memcpy(weights->payloadData.data(), payload, header.payloadSize);
+    const float* floats = weights->payloadData.data();
+    const auto* bytes = reinterpret_cast<const unsigned char*>(floats);
+
+    auto setQuantised = [bytes](Matrix& matrix, const ModelBlob::Layout::Quantised& sections) {
+        matrix.int8Values = reinterpret_cast<const int8_t*>(bytes + sections.int8Values);
+        matrix.halfValues = reinterpret_cast<const uint16_t*>(bytes + sections.halfValues);
+        matrix.int8Scale = reinterpret_cast<const float*>(bytes + sections.int8Scale);
+        matrix.halfScale = reinterpret_cast<const float*>(bytes + sections.halfScale);
+    };
+
+    const auto layout = ModelBlob::layoutFor(weights->unitType, weights->hiddenSize, weights->numLayers);
+    for (int l = 0; l < weights->numLayers; ++l) {
+        auto& layer = weights->layers[l];
+        layer.input.rows = l == 0 ? 2 : weights->hiddenSize;
+        layer.input.values = floats + layout.layers[l].wInput;
+        layer.recurrent.rows = weights->hiddenSize;
+        layer.recurrent.values = floats + layout.layers[l].wRecurrent;
+        layer.bias = floats + layout.layers[l].bias;
+        layer.recurrentBias = floats + layout.layers[l].recurrentBias;
+        setQuantised(layer.input, layout.layers[l].input);
+        setQuantised(layer.recurrent, layout.layers[l].recurrent);
+    }
+
+    weights->denseWeights = floats + layout.denseWeights;
+    weights->denseBias = floats[layout.denseBias];
+
+    store.emplace(header.checksum, StoreEntry { header, weights });
+    return weights;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ModelBlob.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read-only recurrent (LSTM or GRU, one or two layers) + Dense weights in the gate-major
+// layout RT_LSTM runs on. Instances are shared process-wide: every RT_LSTM loading the same
+// model holds a reference to one copy, so many plugin instances stream the same cache lines.
+struct LSTMWeights
+{
+    using UnitType = ModelBlob::UnitType;
+    static constexpr int maxLayers = ModelBlob::maxLayers;
+
+    // Used when the training JSON carries no model_data.sample_rate
+    static constexpr double defaultSampleRate = ModelBlob::defaultSampleRate;
+
+    // Storage the hidden-size matrices are read from; state and accumulation stay in float
+    enum class Precision
+    {
+        Float32 = 0,
+        Float16,
+        Int8
+    };
+
+    // A transposed weight matrix, [rows][gatesSize], plus its reduced-precision copies with
+    // one scale per gate row: W[k][j] = q[j][k] * scale[k]. Half values are raw IEEE bits
+    // decoded by shifting them into a float's mantissa, so halfScale also carries the 2^112
+    // that undoes the exponent rebias.
+    struct Matrix
+    {
+        int rows = 0;
+        const float* values = nullptr;
+        const int8_t* int8Values = nullptr;
+        const float* int8Scale = nullptr;
+        const uint16_t* halfValues = nullptr;
+        const float* halfScale = nullptr;
+    };
+
+    struct Layer
+    {
+        Matrix input;                       // W_ih: audio and drive rows on the first layer
+        Matrix recurrent;                   // W_hh
+        const float* bias = nullptr;        // b_ih + b_hh (b_ih only for the GRU candidate)
+        const float* recurrentBias = nullptr; // GRU candidate b_hh, applied inside the reset gate
+    };
+
+    UnitType unitType = UnitType::LSTM;
+    int hiddenSize = 0;
+    int gatesSize = 0; // 4 * hiddenSize for LSTM (i, f, g, o), 3 * hiddenSize for GRU (r, z, n)
+    int numLayers = 0;
+    Layer layers[maxLayers];
+
+    // Dense head
+    const float* denseWeights = nullptr;
+    float denseBias = 0.f;
+
+    // Dry input added to the model output: 1, or 0 for a model trained without the skip
+    // connection
+    float skipGain = 1.0f;
+
+    // Rate the model was trained at; inference at any other rate shifts its voicing
+    double sampleRate = defaultSampleRate;
+
+    // First layer input columns. Out of line so the per-ISA kernel objects share no code.
+    const float* wAudio() const noexcept;
+    const float* wDrive() const noexcept;
+
+    // Returns the shared weights for a ModelBlob, unpacking it only if no live
+    // instance with the same contents exists. Returns nullptr if the blob is corrupt
+    // or not a 2-input, 1-output model. Not for the audio thread.
+    static std::shared_ptr<const LSTMWeights> fromBinary(const void* data, size_t size);
+
+private:
+    // The payload every view points into: float sections, then the quantised copies that
+    // ModelBlob::fromJson calibrated when the blob was packed
+    std::vector<float> payloadData;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+// Multichannel engines advance channels in groups of up to maxLanes,
+// with their state interleaved so that one SIMD lane holds one channel.
+// The layout does not depend on the instruction set the kernels are picked for
+// at runtime: 8 lanes fill an AVX register and make two SSE or NEON registers.
+namespace LaneLayout
+{
+    constexpr int maxLanes = 8;
+
+    struct Group
+    {
+        int firstChannel = 0;
+        int numLanes = 1;
+    };
+
+    // Widest groups first: 6 channels become 4 + 2, stereo stays a single pair
+    inline std::vector<Group> split(int numChannels)
+    {
+        std::vector<Group> groups;
+        for (int channel = 0; channel < numChannels;) {
+            int lanes = maxLanes;
+            while (lanes > numChannels - channel)
+                lanes /= 2;
+
+            groups.push_back({ channel, lanes });
+            channel += lanes;
+        }
+        return groups;
+    }
+}
@@ -0,0 +1,129 @@
+#include "ModelAccuracy.h"
+#include "RTNeuralLSTM.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace ModelAccuracy
+{
+    static constexpr int blockSize = 512;
+
+    // Log sweep from 20 Hz to 20 kHz (or Nyquist) at level, or white noise for level 0
+    static void fillProbe(std::vector<float>& input, float level, double sampleRate, std::minstd_rand& random)
+    {
+        std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+        const int length = (int) input.size();
+        const double endFrequency = std::min(20000.0, 0.45 * sampleRate);
+        for (int n = 0; n < length; ++n) {
+            const double t = (double) n / length;
+            const double phase = 2.0 * 3.14159265358979323846 * 20.0 * length / sampleRate
+                                 * (std::pow(endFrequency / 20.0, t) - 1.0) / std::log(endFrequency / 20.0);
+            input[(size_t) n] = level > 0.0f ? level * (float) std::sin(phase) : noise(random);
+        }
+    }
+
+    static void run(RT_LSTM& model, const std::vector<float>& input, std::vector<float>& output, float drive)
+    {
+        for (size_t start = 0; start < input.size(); start += blockSize) {
+            const float* in[] = { input.data() + start };
+            float* out[] = { output.data() + start };
+            model.process(in, out, 1, drive, blockSize);
+        }
+    }
+
+    Report measure(const void* blobData, size_t blobSize, LSTMWeights::Precision precision, bool eco)
+    {
+        RT_LSTM reference, approximate;
+        reference.prepare(1, blockSize);
+        approximate.prepare(1, blockSize);
+        if (!reference.load_binary(blobData, blobSize) || !approximate.load_binary(blobData, blobSize))
+            return {};
+
+        approximate.setPrecision(precision);
+        approximate.setEcoMode(eco);
+
+        // A quarter of a second per segment, at the rate the model was trained at
+        const double sampleRate = reference.getModelSampleRate();
+        const int segmentLength = (int) (sampleRate / 4.0) / blockSize * blockSize;
+
+        std::vector<float> input((size_t) segmentLength), expected((size_t) segmentLength), actual((size_t) segmentLength);
+        std::minstd_rand random(1);
+
+        double errorPower = 0.0, signalPower = 0.0;
+        Report report;
+
+        for (float level : { 0.1f, 0.5f, 1.0f, 0.0f }) {
+            for (float drive : { 0.0f, 0.5f, 1.0f }) {
+                fillProbe(input, level, sampleRate, random);
+                run(reference, input, expected, drive);
+                run(approximate, input, actual, drive);
+
+                for (int n = 0; n < segmentLength; ++n) {
+                    const double error = (double) actual[(size_t) n] - expected[(size_t) n];
+                    report.maxAbsError = std::max(report.maxAbsError, std::abs(error));
+                    errorPower += error * error;
+                    signalPower += (double) expected[(size_t) n] * expected[(size_t) n];
+                }
+                report.numSamples += segmentLength;
+            }
+        }
+
+        report.rmsError = std::sqrt(errorPower / std::max(1, report.numSamples));
+        report.snrDb = errorPower > 0.0 ? 10.0 * std::log10(signalPower / errorPower) : std::numeric_limits<double>::infinity();
+        return report;
+    }
+
+    int preRollSamples(std::shared_ptr<const LSTMWeights> weights, float maxError)
+    {
+        RT_LSTM warm, cold;
+        warm.prepare(1, blockSize);
+        cold.prepare(1, blockSize);
+        if (!warm.loadWeights(weights) || !cold.loadWeights(weights))
+            return -1;
+
+        const double sampleRate = warm.getModelSampleRate();
+        const int historyLength = (int) (sampleRate / 4.0) / blockSize * blockSize;
+        const int probeLength = (int) (sampleRate / 2.0) / blockSize * blockSize;
+
+        std::vector<float> history((size_t) historyLength), input((size_t) probeLength);
+        std::vector<float> expected((size_t) std::max(historyLength, probeLength)), actual((size_t) probeLength);
+        std::minstd_rand random(2);
+
+        int preRoll = 0;
+        std::uniform_real_distribution<float> fullScale(-1.0f, 1.0f);
+        for (bool noisyHistory : { true, false }) {
+            for (auto& sample : history)
+                sample = noisyHistory ? fullScale(random) : 0.0f;
+
+            for (float level : { 0.1f, 0.5f, 1.0f, 0.0f }) {
+                for (float drive : { 0.0f, 0.5f, 1.0f }) {
+                    fillProbe(input, level, sampleRate, random);
+
+                    warm.reset();
+                    warm.previousDrive = drive;
+                    run(warm, history, expected, drive);
+                    run(warm, input, expected, drive);
+
+                    cold.reset();
+                    cold.previousDrive = drive;
+                    run(cold, input, actual, drive);
+
+                    int settled = 0;
+                    for (int n = 0; n < probeLength; ++n)
+                        if (std::abs(actual[(size_t) n] - expected[(size_t) n]) > maxError)
+                            settled = n + 1;
+
+                    // Still moving in the last quarter: no sign it settles at all
+                    if (settled > probeLength * 3 / 4)
+                        return -1;
+                    preRoll = std::max(preRoll, settled);
+                }
+            }
+        }
+
+        return preRoll;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "LSTMWeights.h"
+#include <cstddef>
+#include <memory>
+
+// Output error of the approximate inference paths (reduced-precision weights, eco
+// activations, cold starts) against exact Float32 inference of the same model
+namespace ModelAccuracy
+{
+    struct Report
+    {
+        double maxAbsError = 0.0;
+        double rmsError = 0.0;
+        double snrDb = 0.0; // reference output power over error power
+        int numSamples = 0;
+    };
+
+    // Runs both paths over a calibration signal: log sweeps at -20, -6 and 0 dBFS plus
+    // white noise, each at drive 0, 0.5 and 1. Returns an empty report for a bad blob.
+    Report measure(const void* blobData, size_t blobSize, LSTMWeights::Precision precision, bool eco = false);
+
+    // Samples (at the model's rate) a freshly reset model must run before its output stays
+    // within maxError of an instance that has been running all along. Probed with the same
+    // sweeps and noise at every drive, after either full-scale noise or silence. Returns -1
+    // if some probe has not settled within half a second.
+    int preRollSamples(std::shared_ptr<const LSTMWeights> weights, float maxError);
+}
@@ -0,0 +1,454 @@
+#include "ModelBlobJson.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace ModelBlob
+{
+    using Vec2d = std::vector<std::vector<float>>;
+
+    static constexpr char magic[4] = { 'P', 'D', 'M', 'B' };
+
+    Layout layoutFor(UnitType unitType, int hiddenSize, int numLayers) noexcept
+    {
+        // Sections start on 64-byte boundaries relative to the payload
+        auto padded = [] (size_t numFloats) { return (numFloats + 15) & ~size_t (15); };
+        const auto hidden = (size_t) hiddenSize;
+        const auto gatesSize = (size_t) gatesPerUnit(unitType) * hidden;
+
+        Layout layout {};
+        size_t offset = 0;
+        for (int l = 0; l < numLayers && l < maxLayers; ++l) {
+            auto& layer = layout.layers[l];
+            layer.wInput = offset;
+            offset += padded((l == 0 ? 2 : hidden) * gatesSize);
+            layer.wRecurrent = offset;
+            offset += padded(hidden * gatesSize);
+            layer.bias = offset;
+            offset += padded(gatesSize);
+            layer.recurrentBias = offset;
+            offset += padded(hidden);
+        }
+        layout.denseWeights = offset;
+        offset += padded(hidden);
+        layout.denseBias = offset;
+        offset += padded(1);
+        layout.numFloats = offset;
+
+        auto paddedBytes = [] (size_t numBytes) { return (numBytes + 63) & ~size_t (63); };
+        size_t bytes = offset * sizeof(float);
+        for (int l = 0; l < numLayers && l < maxLayers; ++l) {
+            auto& layer = layout.layers[l];
+            for (auto* sections : { &layer.input, &layer.recurrent }) {
+                const size_t rows = sections == &layer.input && l == 0 ? 2 : hidden;
+                sections->int8Values = bytes;
+                bytes += paddedBytes(rows * gatesSize * sizeof(int8_t));
+                sections->halfValues = bytes;
+                bytes += paddedBytes(rows * gatesSize * sizeof(uint16_t));
+                sections->int8Scale = bytes;
+                bytes += paddedBytes(gatesSize * sizeof(float));
+                sections->halfScale = bytes;
+                bytes += paddedBytes(gatesSize * sizeof(float));
+            }
+        }
+        layout.payloadSize = bytes;
+        return layout;
+    }
+
+    uint32_t checksum(const void* data, size_t size) noexcept
+    {
+        auto* bytes = static_cast<const unsigned char*>(data);
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    bool parse(const void* data, size_t size, Header& header, const unsigned char*& payload) noexcept
+    {
+        if (data == nullptr || size < sizeof(Header))
+            return false;
+
+        std::memcpy(&header, data, sizeof(Header));
+        payload = static_cast<const unsigned char*>(data) + sizeof(Header);
+
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != currentVersion)
+            return false;
+
+        if (header.hiddenSize == 0 || header.hiddenSize > 1024 || header.numLayers == 0 || header.numLayers > maxLayers
+            || header.unitType > (uint32_t) UnitType::GRU || (header.flags & ~(uint32_t) knownFlags) != 0
+            || header.payloadSize != layoutFor((UnitType) header.unitType, (int) header.hiddenSize, (int) header.numLayers).payloadSize
+            || header.payloadSize > size - sizeof(Header))
+            return false;
+
+        return checksum(payload, header.payloadSize) == header.checksum;
+    }
+
+    // The float sections of a payload being packed, enough to run the model for calibration
+    struct PackedModel
+    {
+        UnitType unitType;
+        int hiddenSize, gatesSize, numLayers;
+        double sampleRate;
+        const float* floats;
+        Layout layout;
+
+        int inputRows(int layer) const noexcept { return layer == 0 ? 2 : hiddenSize; }
+    };
+
+    // Rounds v (|v| <= 1) to half precision and returns the bits shifted down from a float
+    // scaled by 2^-112, which is exactly what the kernels shift back up
+    static uint16_t toHalfBits(float v) noexcept
+    {
+        const float scaled = v * 0x1.0p-112f;
+        uint32_t bits;
+        std::memcpy(&bits, &scaled, sizeof(bits));
+
+        const uint32_t magnitude = ((bits & 0x7fffffffu) + 0x1000u) >> 13;
+        return (uint16_t) (((bits >> 16) & 0x8000u) | (magnitude & 0x7fffu));
+    }
+
+    // Mean outer product x x^T of the vector each matrix multiplies, in quantise()'s matrix
+    // order, gathered by running the model in double over log sweeps at -20, -6 and 0 dBFS and
+    // white noise, each at drive 0, 0.5 and 1
+    static std::vector<std::vector<double>> measureInputCorrelations(const PackedModel& w)
+    {
+        const int hiddenSize = w.hiddenSize, gatesSize = w.gatesSize;
+        const bool isGru = w.unitType == UnitType::GRU;
+
+        std::vector<std::vector<double>> correlations;
+        for (int l = 0; l < w.numLayers; ++l) {
+            for (int rows : { w.inputRows(l), hiddenSize })
+                correlations.emplace_back((size_t) rows * (size_t) rows, 0.0);
+        }
+
+        auto accumulate = [](std::vector<double>& correlation, const double* x, int rows) {
+            for (int a = 0; a < rows; ++a)
+                for (int b = 0; b < rows; ++b)
+                    correlation[(size_t) (a * rows + b)] += x[a] * x[b];
+        };
+
+        auto sigmoid = [](double x) { return 1.0 / (1.0 + std::exp(-x)); };
+
+        std::vector<double> hidden[maxLayers], cell[maxLayers];
+        for (int l = 0; l < w.numLayers; ++l) {
+            hidden[l].assign((size_t) hiddenSize, 0.0);
+            cell[l].assign((size_t) hiddenSize, 0.0);
+        }
+
+        std::vector<double> gates((size_t) gatesSize), recurrent((size_t) gatesSize), below((size_t) hiddenSize);
+        uint32_t noiseState = 1;
+
+        // A thirty-second of a second per segment is plenty for the statistics and keeps loading quick
+        const int segmentLength = (int) (w.sampleRate / 32.0);
+        const double endFrequency = std::min(20000.0, 0.45 * w.sampleRate);
+        int numSteps = 0;
+
+        for (double level : { 0.1, 0.5, 1.0, 0.0 }) {
+            for (double drive : { 0.0, 0.5, 1.0 }) {
+                for (int n = 0; n < segmentLength; ++n) {
+                    double input;
+                    if (level > 0.0) {
+                        const double t = (double) n / segmentLength;
+                        const double phase = 2.0 * 3.14159265358979323846 * 20.0 * segmentLength / w.sampleRate
+                                             * (std::pow(endFrequency / 20.0, t) - 1.0) / std::log(endFrequency / 20.0);
+                        input = level * std::sin(phase);
+                    } else {
+                        noiseState = noiseState * 1664525u + 1013904223u;
+                        input = (double) noiseState / 4294967296.0 - 0.5;
+                    }
+
+                    const double audioAndDrive[] = { input, drive };
+                    const double* x = audioAndDrive;
+
+                    for (int l = 0; l < w.numLayers; ++l) {
+                        const auto& layer = w.layout.layers[l];
+                        const float* wInput = w.floats + layer.wInput;
+                        const float* wRecurrent = w.floats + layer.wRecurrent;
+                        const float* bias = w.floats + layer.bias;
+                        const float* recurrentBias = w.floats + layer.recurrentBias;
+                        const int inputRows = w.inputRows(l);
+                        double* h = hidden[l].data();
+
+                        accumulate(correlations[(size_t) (2 * l)], x, inputRows);
+                        accumulate(correlations[(size_t) (2 * l + 1)], h, hiddenSize);
+
+                        for (int k = 0; k < gatesSize; ++k) {
+                            gates[(size_t) k] = bias[k];
+                            recurrent[(size_t) k] = 0.0;
+                        }
+
+                        for (int j = 0; j < inputRows; ++j)
+                            for (int k = 0; k < gatesSize; ++k)
+                                gates[(size_t) k] += wInput[j * gatesSize + k] * x[j];
+
+                        for (int j = 0; j < hiddenSize; ++j)
+                            for (int k = 0; k < gatesSize; ++k)
+                                recurrent[(size_t) k] += wRecurrent[j * gatesSize + k] * h[j];
+
+                        for (int j = 0; j < hiddenSize; ++j) {
+                            if (isGru) {
+                                const double r = sigmoid(gates[(size_t) j] + recurrent[(size_t) j]);
+                                const double z = sigmoid(gates[(size_t) (hiddenSize + j)] + recurrent[(size_t) (hiddenSize + j)]);
+                                const double c = std::tanh(gates[(size_t) (2 * hiddenSize + j)]
+                                                           + r * (recurrent[(size_t) (2 * hiddenSize + j)] + recurrentBias[j]));
+                                h[j] = c + z * (h[j] - c);
+                            } else {
+                                const double i = sigmoid(gates[(size_t) j] + recurrent[(size_t) j]);
+                                const double f = sigmoid(gates[(size_t) (hiddenSize + j)] + recurrent[(size_t) (hiddenSize + j)]);
+                                const double g = std::tanh(gates[(size_t) (2 * hiddenSize + j)] + recurrent[(size_t) (2 * hiddenSize + j)]);
+                                const double o = sigmoid(gates[(size_t) (3 * hiddenSize + j)] + recurrent[(size_t) (3 * hiddenSize + j)]);
+                                cell[l][(size_t) j] = f * cell[l][(size_t) j] + i * g;
+                                h[j] = o * std::tanh(cell[l][(size_t) j]);
+                            }
+                        }
+
+                        below = hidden[l];
+                        x = below.data();
+                    }
+
+                    ++numSteps;
+                }
+            }
+        }
+
+        for (auto& correlation : correlations)
+            for (auto& value : correlation)
+                value /= numSteps;
+
+        return correlations;
+    }
+
+    // Upper triangular U with U^T U = (H + damping)^-1, the factor GPTQ spreads rounding errors
+    // with. H is rows x rows and positive semi-definite.
+    static std::vector<double> inverseCholeskyFactor(std::vector<double> h, int rows)
+    {
+        double meanDiagonal = 0.0;
+        for (int j = 0; j < rows; ++j)
+            meanDiagonal += h[(size_t) (j * rows + j)];
+        meanDiagonal = std::max(meanDiagonal / rows, 1.0e-12);
+
+        // Damping keeps inputs that barely move (or never do) from blowing up the inverse
+        for (int j = 0; j < rows; ++j)
+            h[(size_t) (j * rows + j)] += 0.01 * meanDiagonal;
+
+        // In-place Cholesky, H = L L^T
+        auto choleskyLower = [rows](std::vector<double>& a) {
+            for (int j = 0; j < rows; ++j) {
+                for (int i = j; i < rows; ++i) {
+                    double sum = a[(size_t) (i * rows + j)];
+                    for (int k = 0; k < j; ++k)
+                        sum -= a[(size_t) (i * rows + k)] * a[(size_t) (j * rows + k)];
+                    a[(size_t) (i * rows + j)] = i == j ? std::sqrt(std::max(sum, 1.0e-30)) : sum / a[(size_t) (j * rows + j)];
+                }
+                for (int i = 0; i < j; ++i)
+                    a[(size_t) (i * rows + j)] = 0.0;
+            }
+        };
+
+        choleskyLower(h);
+
+        // H^-1 = L^-T L^-1, from the inverse of the triangle
+        std::vector<double> lowerInverse((size_t) rows * (size_t) rows, 0.0);
+        for (int j = 0; j < rows; ++j) {
+            lowerInverse[(size_t) (j * rows + j)] = 1.0 / h[(size_t) (j * rows + j)];
+            for (int i = j + 1; i < rows; ++i) {
+                double sum = 0.0;
+                for (int k = j; k < i; ++k)
+                    sum -= h[(size_t) (i * rows + k)] * lowerInverse[(size_t) (k * rows + j)];
+                lowerInverse[(size_t) (i * rows + j)] = sum / h[(size_t) (i * rows + i)];
+            }
+        }
+
+        std::vector<double> inverse((size_t) rows * (size_t) rows, 0.0);
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < rows; ++j)
+                for (int k = std::max(i, j); k < rows; ++k)
+                    inverse[(size_t) (i * rows + j)] += lowerInverse[(size_t) (k * rows + i)] * lowerInverse[(size_t) (k * rows + j)];
+
+        // U = chol(H^-1)^T
+        choleskyLower(inverse);
+        std::vector<double> upper((size_t) rows * (size_t) rows, 0.0);
+        for (int i = 0; i < rows; ++i)
+            for (int j = i; j < rows; ++j)
+                upper[(size_t) (i * rows + j)] = inverse[(size_t) (j * rows + i)];
+
+        return upper;
+    }
+
+    // Fills the reduced-precision sections of a payload from its float sections. Int8 rows are
+    // rounded GPTQ-style against input statistics from a short synthetic run, at the clip level
+    // that leaves the least error on the gate.
+    static void quantise(const PackedModel& model, unsigned char* payload)
+    {
+        struct Matrix
+        {
+            int rows;
+            const float* values;
+            const Layout::Quantised* sections;
+        };
+
+        std::vector<Matrix> matrices;
+        for (int l = 0; l < model.numLayers; ++l) {
+            const auto& layer = model.layout.layers[l];
+            matrices.push_back({ model.inputRows(l), model.floats + layer.wInput, &layer.input });
+            matrices.push_back({ model.hiddenSize, model.floats + layer.wRecurrent, &layer.recurrent });
+        }
+
+        const int gatesSize = model.gatesSize;
+        const auto correlations = measureInputCorrelations(model);
+
+        for (size_t m = 0; m < matrices.size(); ++m) {
+            const auto& matrix = matrices[m];
+            auto* q8 = reinterpret_cast<int8_t*>(payload + matrix.sections->int8Values);
+            auto* q16 = reinterpret_cast<uint16_t*>(payload + matrix.sections->halfValues);
+            auto* int8Scale = reinterpret_cast<float*>(payload + matrix.sections->int8Scale);
+            auto* halfScale = reinterpret_cast<float*>(payload + matrix.sections->halfScale);
+
+            const int rows = matrix.rows;
+            const float* w = matrix.values;
+            const auto& correlation = correlations[m];
+            const auto spread = inverseCholeskyFactor(correlation, rows);
+            std::vector<double> column((size_t) rows);
+            std::vector<int8_t> candidate((size_t) rows);
+
+            for (int k = 0; k < gatesSize; ++k) {
+                float peak = 0.0f;
+                for (int j = 0; j < rows; ++j)
+                    peak = std::max(peak, std::abs(w[j * gatesSize + k]));
+
+                // An all-zero column stays zero in both copies
+                if (peak <= 0.0f)
+                    continue;
+
+                // Half: normalise the row, no clipping needed
+                halfScale[k] = peak * 0x1.0p112f;
+                for (int j = 0; j < rows; ++j)
+                    q16[j * gatesSize + k] = toHalfBits(w[j * gatesSize + k] / peak);
+
+                // Int8: GPTQ-style rounding. Each weight's rounding error is pushed onto the
+                // weights not yet rounded, in proportion to how their inputs correlate, so the
+                // errors cancel in the gate instead of adding up. The clip level that leaves the
+                // least error on the gate, e^T E[x x^T] e, wins.
+                double bestError = -1.0;
+                for (int step = 0; step <= 20; ++step) {
+                    const double scale = peak * (1.0 - 0.02 * step) / 127.0;
+
+                    for (int j = 0; j < rows; ++j)
+                        column[(size_t) j] = w[j * gatesSize + k];
+
+                    for (int j = 0; j < rows; ++j) {
+                        const double q = std::clamp(std::round(column[(size_t) j] / scale), -127.0, 127.0);
+                        candidate[(size_t) j] = (int8_t) q;
+
+                        const double error = (column[(size_t) j] - q * scale) / spread[(size_t) (j * rows + j)];
+                        for (int i = j + 1; i < rows; ++i)
+                            column[(size_t) i] -= error * spread[(size_t) (j * rows + i)];
+                    }
+
+                    double gateError = 0.0;
+                    for (int a = 0; a < rows; ++a) {
+                        const double ea = candidate[(size_t) a] * scale - w[a * gatesSize + k];
+                        for (int b = 0; b < rows; ++b)
+                            gateError += ea * correlation[(size_t) (a * rows + b)] * (candidate[(size_t) b] * scale - w[b * gatesSize + k]);
+                    }
+
+                    if (bestError < 0.0 || gateError < bestError) {
+                        bestError = gateError;
+                        int8Scale[k] = (float) scale;
+                        for (int j = 0; j < rows; ++j)
+                            q8[j * gatesSize + k] = candidate[(size_t) j];
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<char> fromJson(const nlohmann::json& modelJson)
+    {
+        const auto& modelData = modelJson.at("model_data");
+        const auto unitName = modelData.at("unit_type").get<std::string>();
+        if (unitName != "LSTM" && unitName != "GRU")
+            throw std::runtime_error("ModelBlob: unit_type must be LSTM or GRU");
+
+        const auto unitType = unitName == "GRU" ? UnitType::GRU : UnitType::LSTM;
+        const int numLayers = modelData.at("num_layers").get<int>();
+        const int inputSize = modelData.at("input_size").get<int>();
+        const int hiddenSize = modelData.at("hidden_size").get<int>();
+        const int outputSize = modelData.at("output_size").get<int>();
+        if (numLayers < 1 || numLayers > maxLayers)
+            throw std::runtime_error("ModelBlob: only one or two recurrent layers are supported");
+        if (inputSize != 2 || outputSize != 1 || hiddenSize <= 0)
+            throw std::runtime_error("ModelBlob: expected 2 inputs (audio, drive) and 1 output");
+
+        // RTNeural captures write skip as a count of skip connections, others as a bool
+        const auto skip = modelData.value("skip", nlohmann::json(1));
+        if (!skip.is_boolean() && !skip.is_number())
+            throw std::runtime_error("ModelBlob: skip must be a number or a bool");
+        const bool hasSkip = skip.is_boolean() ? skip.get<bool>() : skip.get<double>() > 0.0;
+
+        const int gatesSize = gatesPerUnit(unitType) * hiddenSize;
+        const auto layout = layoutFor(unitType, hiddenSize, numLayers);
+        std::vector<float> weights(layout.payloadSize / sizeof(float), 0.0f);
+
+        const auto& stateDict = modelJson.at("state_dict");
+        for (int l = 0; l < numLayers; ++l) {
+            const auto& layer = layout.layers[l];
+            const auto suffix = "_l" + std::to_string(l);
+            const int layerInputs = l == 0 ? inputSize : hiddenSize;
+
+            Vec2d weights_ih = stateDict.at("rec.weight_ih" + suffix);
+            for (int k = 0; k < gatesSize; ++k)
+                for (int i = 0; i < layerInputs; ++i)
+                    weights[layer.wInput + (size_t) i * (size_t) gatesSize + (size_t) k] = weights_ih.at((size_t) k).at((size_t) i);
+
+            Vec2d weights_hh = stateDict.at("rec.weight_hh" + suffix);
+            for (int k = 0; k < gatesSize; ++k)
+                for (int j = 0; j < hiddenSize; ++j)
+                    weights[layer.wRecurrent + (size_t) j * (size_t) gatesSize + (size_t) k] = weights_hh.at((size_t) k).at((size_t) j);
+
+            std::vector<float> bias_ih = stateDict.at("rec.bias_ih" + suffix);
+            std::vector<float> bias_hh = stateDict.at("rec.bias_hh" + suffix);
+            for (int k = 0; k < gatesSize; ++k) {
+                // The GRU candidate's recurrent bias is scaled by the reset gate, so it stays apart
+                const bool candidate = unitType == UnitType::GRU && k >= 2 * hiddenSize;
+                weights[layer.bias + (size_t) k] = bias_ih.at((size_t) k) + (candidate ? 0.0f : bias_hh.at((size_t) k));
+                if (candidate)
+                    weights[layer.recurrentBias + (size_t) (k - 2 * hiddenSize)] = bias_hh.at((size_t) k);
+            }
+        }
+
+        Vec2d dense_weights = modelJson["/state_dict/lin.weight"_json_pointer];
+        for (int j = 0; j < hiddenSize; ++j)
+            weights[layout.denseWeights + (size_t) j] = dense_weights.at(0).at((size_t) j);
+
+        std::vector<float> dense_bias = modelJson["/state_dict/lin.bias"_json_pointer];
+        weights[layout.denseBias] = dense_bias.at(0);
+
+        const auto sampleRate = modelData.value("sample_rate", 0u);
+        const PackedModel model { unitType, hiddenSize, gatesSize, numLayers, sampleRate != 0 ? (double) sampleRate : defaultSampleRate, weights.data(), layout };
+        quantise(model, reinterpret_cast<unsigned char*>(weights.data()));
+
+        Header header {};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = currentVersion;
+        header.unitType = (uint32_t) unitType;
+        header.inputSize = (uint32_t) inputSize;
+        header.hiddenSize = (uint32_t) hiddenSize;
+        header.outputSize = (uint32_t) outputSize;
+        header.numLayers = (uint32_t) numLayers;
+        header.sampleRate = sampleRate;
+        header.flags = hasSkip ? 0u : (uint32_t) noSkip;
+        header.payloadSize = (uint32_t) (weights.size() * sizeof(float));
+        header.checksum = checksum(weights.data(), header.payloadSize);
+
+        std::vector<char> blob(sizeof(Header) + header.payloadSize);
+        std::memcpy(blob.data(), &header, sizeof(Header));
+        std::memcpy(blob.data() + sizeof(Header), weights.data(), header.payloadSize);
+        return blob;
+    }
+}
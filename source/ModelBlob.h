@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Packed model format generated at build time from the training JSON by tools/ModelConverter.
+// A 64-byte Header is followed by little-endian float32 sections, pre-transposed to the
+// layout RT_LSTM runs on and each padded to 64 bytes. With G = gatesPerUnit * H, per layer:
+//   wInput[inputs][G] (2 inputs on the first layer, H after), wRecurrent[H][G],
+//   bias[G] (b_ih + b_hh, except b_ih alone for the GRU candidate gate), recurrentBias[H]
+//   (the GRU candidate's b_hh, which sits inside the reset gate; zero for LSTM)
+// then denseWeights[H], denseBias. The reduced-precision copies follow, calibrated when the
+// blob is packed so loading never has to: for each layer's wInput then wRecurrent,
+//   int8[rows][G], half[rows][G] (uint16 bits), int8Scale[G], halfScale[G] (float32)
+// again each padded to 64 bytes.
+namespace ModelBlob
+{
+    constexpr uint32_t currentVersion = 3;
+    constexpr int maxLayers = 2;
+
+    // Assumed when the training JSON carries no model_data.sample_rate
+    constexpr double defaultSampleRate = 44100.0;
+
+    // PyTorch gate order: LSTM i, f, g, o; GRU r, z, n
+    enum class UnitType : uint32_t
+    {
+        LSTM = 0,
+        GRU
+    };
+
+    constexpr int gatesPerUnit(UnitType unitType) noexcept { return unitType == UnitType::GRU ? 3 : 4; }
+
+    struct Header
+    {
+        char magic[4];        // "PDMB"
+        uint32_t version;
+        uint32_t unitType;
+        uint32_t inputSize;
+        uint32_t hiddenSize;
+        uint32_t outputSize;
+        uint32_t numLayers;
+        uint32_t payloadSize; // bytes following the header
+        uint32_t checksum;    // FNV-1a of the payload
+        uint32_t sampleRate;  // Hz the model was trained at, 0 if the JSON did not say
+        uint32_t flags;       // Flags; zero in blobs packed before there were any
+        uint32_t reserved[5];
+    };
+
+    enum Flags : uint32_t
+    {
+        noSkip = 1u << 0, // trained with model_data.skip = 0: the output is the model alone, without the dry input
+        knownFlags = noSkip
+    };
+
+    static_assert(sizeof(Header) == 64);
+
+    // Offsets of each section inside the payload: in floats for the float32 sections, in
+    // bytes for the quantised ones
+    struct Layout
+    {
+        struct Quantised
+        {
+            size_t int8Values, halfValues, int8Scale, halfScale;
+        };
+
+        struct Layer
+        {
+            size_t wInput, wRecurrent, bias, recurrentBias;
+            Quantised input, recurrent;
+        };
+
+        Layer layers[maxLayers];
+        size_t denseWeights, denseBias, numFloats;
+        size_t payloadSize; // bytes, a multiple of 64
+    };
+
+    Layout layoutFor(UnitType unitType, int hiddenSize, int numLayers) noexcept;
+
+    uint32_t checksum(const void* data, size_t size) noexcept;
+
+    // Validates magic, version, sizes and checksum. On success the header is copied out
+    // and payload points into the caller's bytes; nothing is allocated.
+    bool parse(const void* data, size_t size, Header& header, const unsigned char*& payload) noexcept;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ModelBlob.h"
+#include <RTNeural/RTNeural.h>
+#include <vector>
+
+// The JSON side of ModelBlob, apart from the format so that the per-ISA kernel translation
+// units, which see the format through LSTMWeights.h, never include RTNeural or the JSON library
+namespace ModelBlob
+{
+    // Packs a training JSON (model_data + state_dict), calibrating the int8 and fp16 copies
+    // on the way, which runs the model for a while. Throws on unsupported architectures.
+    std::vector<char> fromJson(const nlohmann::json& modelJson);
+}
@@ -0,0 +1,184 @@
+#include "ModelResampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+static constexpr double pi = 3.14159265358979323846;
+
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1.0e-12)
+            break;
+    }
+    return sum;
+}
+
+bool PolyphaseResampler::prepare(int numChannels, double inRate, double outRate, int tapsPerPhase, double kaiserBeta, double rolloff)
+{
+    const auto in = (long long) std::llround(inRate);
+    const auto out = (long long) std::llround(outRate);
+    const auto divisor = std::gcd(in, out);
+    if (in <= 0 || out <= 0 || out / divisor > maxPhases || in / divisor > maxPhases * 16)
+        return false;
+
+    L = (int) (out / divisor);
+    M = (int) (in / divisor);
+    // When decimating the cutoff shrinks by L / M, so the filter must span more inputs
+    taps = tapsPerPhase * (int) ((M + L - 1) / L);
+
+    // Prototype low-pass at the intermediate rate inRate * L, cut below the lower Nyquist
+    const int length = L * taps;
+    const double cutoff = 0.5 * rolloff / (double) std::max(L, M);
+    const double centre = 0.5 * (length - 1);
+    const double norm = besselI0(kaiserBeta);
+
+    branches.assign((size_t) length, 0.0f);
+    for (int n = 0; n < length; ++n) {
+        const double t = n - centre;
+        const double sinc = std::equal_to<double>()(t, 0.0) ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * t) / (pi * t);
+        const double r = 2.0 * n / (length - 1) - 1.0;
+        const double window = besselI0(kaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) / norm;
+
+        // Branch p holds h[p + j * L], stored reversed so the newest input meets the last tap
+        const int p = n % L;
+        const int j = n / L;
+        branches[(size_t) (p * taps + (taps - 1 - j))] = (float) (L * sinc * window);
+    }
+
+    history.assign((size_t) numChannels, std::vector<float>((size_t) (2 * taps), 0.0f));
+    reset();
+    return true;
+}
+
+void PolyphaseResampler::reset()
+{
+    phase = 0;
+    historyPos = 0;
+    for (auto& channelHistory : history)
+        std::fill(channelHistory.begin(), channelHistory.end(), 0.0f);
+}
+
+int PolyphaseResampler::process(const float* const* in, int numIn, float* const* out) noexcept
+{
+    const int startPhase = phase;
+    const int startPos = historyPos;
+    int numOut = 0;
+
+    for (size_t ch = 0; ch < history.size(); ++ch) {
+        float* hist = history[ch].data();
+        const float* input = in[ch];
+        float* output = out[ch];
+
+        phase = startPhase;
+        historyPos = startPos;
+        numOut = 0;
+
+        for (int n = 0; n < numIn; ++n) {
+            // Written twice so hist[historyPos + 1 ... historyPos + taps] is the window, oldest first
+            historyPos = historyPos + 1 < taps ? historyPos + 1 : 0;
+            hist[historyPos] = input[n];
+            hist[historyPos + taps] = input[n];
+
+            // Every output whose intermediate time falls inside this input period
+            const float* window = hist + historyPos + 1;
+            for (; phase < L; phase += M) {
+                const float* branch = branches.data() + (size_t) phase * (size_t) taps;
+                float sum = 0.0f;
+                for (int j = 0; j < taps; ++j)
+                    sum += branch[j] * window[j];
+                output[numOut++] = sum;
+            }
+            phase -= L;
+        }
+    }
+
+    return numOut;
+}
+
+void ModelResampler::prepare(int numChannels, int maxBlockSizeToUse, double hostRate, double modelRate)
+{
+    numChannels = std::max(1, numChannels);
+    maxBlockSizeToUse = std::max(1, maxBlockSizeToUse);
+
+    // Hosts call prepareToPlay on every transport start; the filter banks only depend on these
+    if (numChannels == numPreparedChannels && maxBlockSizeToUse == maxBlockSize
+        && std::equal_to<double>()(hostRate, preparedHostRate) && std::equal_to<double>()(modelRate, preparedModelRate)) {
+        reset();
+        return;
+    }
+
+    numPreparedChannels = numChannels;
+    maxBlockSize = maxBlockSizeToUse;
+    preparedHostRate = hostRate;
+    preparedModelRate = modelRate;
+
+    // Taps per branch, Kaiser beta and passband edge for Eco, Normal, High
+    struct Design
+    {
+        int taps;
+        double beta, rolloff;
+    };
+    constexpr Design designs[] = { { 8, 5.0, 0.80 }, { 16, 7.0, 0.90 }, { 32, 9.0, 0.95 } };
+
+    active = std::llround(hostRate) != std::llround(modelRate);
+    for (size_t q = 0; q < downsamplers.size() && active; ++q) {
+        const auto& design = designs[q];
+        active = downsamplers[q].prepare(numPreparedChannels, hostRate, modelRate, design.taps, design.beta, design.rolloff)
+                 && upsamplers[q].prepare(numPreparedChannels, modelRate, hostRate, design.taps, design.beta, design.rolloff);
+
+        const double delay = downsamplers[q].getDelaySeconds(hostRate) + upsamplers[q].getDelaySeconds(modelRate);
+        latencySamples[q] = (int) std::lround(delay * hostRate);
+    }
+
+    if (!active) {
+        maxModelBlockSize = 0;
+        latencySamples = {};
+        return;
+    }
+
+    maxModelBlockSize = 0;
+    int maxRoundTrip = 0;
+    for (size_t q = 0; q < downsamplers.size(); ++q) {
+        const int modelSamples = downsamplers[q].getMaxOutputs(maxBlockSize);
+        maxModelBlockSize = std::max(maxModelBlockSize, modelSamples);
+        maxRoundTrip = std::max(maxRoundTrip, upsamplers[q].getMaxOutputs(modelSamples));
+    }
+
+    // After n host samples the downsampler has produced ceil(n * L / M) and the upsampler
+    // ceil(that * M / L) >= n, so the fifo never runs dry and only holds the surplus
+    modelBuffers.assign((size_t) numPreparedChannels, std::vector<float>((size_t) maxModelBlockSize, 0.0f));
+    fifo.assign((size_t) numPreparedChannels, std::vector<float>((size_t) (maxBlockSize + maxRoundTrip), 0.0f));
+
+    modelPtrs.resize((size_t) numPreparedChannels);
+    offsetIo.resize((size_t) numPreparedChannels);
+    fifoWritePtrs.resize((size_t) numPreparedChannels);
+    for (size_t ch = 0; ch < modelBuffers.size(); ++ch)
+        modelPtrs[ch] = modelBuffers[ch].data();
+
+    reset();
+}
+
+void ModelResampler::reset()
+{
+    for (auto& resampler : downsamplers)
+        resampler.reset();
+    for (auto& resampler : upsamplers)
+        resampler.reset();
+
+    fifoCount = 0;
+}
+
+void ModelResampler::setQuality(Quality newQuality) noexcept
+{
+    if (newQuality == quality)
+        return;
+
+    quality = newQuality;
+    reset();
+}
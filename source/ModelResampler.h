@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Streaming rational resampler (upsample by L, filter, downsample by M) built as a
+// polyphase bank of Kaiser-windowed sinc branches. Channels share one phase.
+class PolyphaseResampler
+{
+public:
+    // Builds the filter for inRate -> outRate with tapsPerPhase taps per branch when
+    // interpolating (scaled up by the ratio when decimating). Returns false if the ratio needs more
+    // than maxPhases branches, in which case the resampler must not be used.
+    bool prepare(int numChannels, double inRate, double outRate, int tapsPerPhase, double kaiserBeta, double rolloff);
+    void reset();
+
+    // Consumes numIn samples per channel and returns how many were written to out
+    int process(const float* const* in, int numIn, float* const* out) noexcept;
+
+    // Most outputs process() can return for numIn inputs
+    int getMaxOutputs(int numIn) const noexcept { return (int) (((long long) numIn * L + M - 1) / M) + 1; }
+
+    // Group delay in seconds at the input rate
+    double getDelaySeconds(double inRate) const noexcept { return ((double) L * taps - 1.0) / (2.0 * L * inRate); }
+
+    static constexpr int maxPhases = 1024;
+
+private:
+    int L = 1, M = 1, taps = 1;
+    int phase = 0;
+    int historyPos = 0;
+
+    std::vector<float> branches;              // [L][taps], each branch reversed for an ascending dot product
+    std::vector<std::vector<float>> history;  // per channel, 2 * taps so the window is always contiguous
+};
+
+// Runs a model at the rate it was trained at: each block is downsampled from the host
+// rate, processed in place at the model rate, then upsampled back into the host buffer.
+// All three quality settings are built in prepare() so switching between them is free.
+class ModelResampler
+{
+public:
+    enum class Quality
+    {
+        Eco = 0,
+        Normal,
+        High
+    };
+
+    // Preparing again with the same arguments only resets, keeping the filter banks
+    void prepare(int numChannels, int maxBlockSize, double hostRate, double modelRate);
+    void reset();
+
+    // Switches filter bank and clears the resampling state; allocation-free
+    void setQuality(Quality newQuality) noexcept;
+    Quality getQuality() const noexcept { return quality; }
+
+    // False when the host already runs at the model rate (or the ratio is impractical)
+    bool isActive() const noexcept { return active; }
+
+    // Delay of the down + up round trip for a quality, in host samples
+    int getLatencySamples(Quality q) const noexcept { return active ? latencySamples[(size_t) q] : 0; }
+    int getLatencySamples() const noexcept { return getLatencySamples(quality); }
+
+    // Largest number of model-rate samples handed to processModel at once
+    int getMaxModelBlockSize() const noexcept { return maxModelBlockSize; }
+
+    // processModel(float* const* channels, int numSamples) runs the model in place.
+    // When inactive it is simply called on io.
+    template <typename ProcessModel>
+    void process(float* const* io, int numChannels, int numSamples, ProcessModel&& processModel) noexcept
+    {
+        if (!active) {
+            processModel(io, numSamples);
+            return;
+        }
+
+        for (int start = 0; start < numSamples; start += maxBlockSize) {
+            const int blockSize = numSamples - start < maxBlockSize ? numSamples - start : maxBlockSize;
+
+            for (int ch = 0; ch < numPreparedChannels; ++ch)
+                offsetIo[(size_t) ch] = io[ch < numChannels ? ch : 0] + start;
+
+            const int numModelSamples = down().process(offsetIo.data(), blockSize, modelPtrs.data());
+            processModel(modelPtrs.data(), numModelSamples);
+
+            for (int ch = 0; ch < numPreparedChannels; ++ch)
+                fifoWritePtrs[(size_t) ch] = fifo[(size_t) ch].data() + fifoCount;
+            fifoCount += up().process(modelPtrs.data(), numModelSamples, fifoWritePtrs.data());
+
+            // The round trip never produces fewer samples than went in (see prepare())
+            const int ready = fifoCount < blockSize ? fifoCount : blockSize;
+            for (int ch = 0; ch < numChannels && ch < numPreparedChannels; ++ch) {
+                auto& channelFifo = fifo[(size_t) ch];
+                std::copy(channelFifo.begin(), channelFifo.begin() + ready, io[ch] + start);
+                std::copy(channelFifo.begin() + ready, channelFifo.begin() + fifoCount, channelFifo.begin());
+            }
+            fifoCount -= ready;
+        }
+    }
+
+private:
+    PolyphaseResampler& down() noexcept { return downsamplers[(size_t) quality]; }
+    PolyphaseResampler& up() noexcept { return upsamplers[(size_t) quality]; }
+
+    std::array<PolyphaseResampler, 3> downsamplers;
+    std::array<PolyphaseResampler, 3> upsamplers;
+    std::array<int, 3> latencySamples {};
+    Quality quality = Quality::Normal;
+    bool active = false;
+
+    int numPreparedChannels = 0;
+    int maxBlockSize = 0;
+    int maxModelBlockSize = 0;
+    double preparedHostRate = 0.0;
+    double preparedModelRate = 0.0;
+
+    std::vector<std::vector<float>> modelBuffers;
+    std::vector<float*> modelPtrs;
+    std::vector<const float*> offsetIo;
+
+    // Host-rate output waiting to be handed back
+    std::vector<std::vector<float>> fifo;
+    std::vector<float*> fifoWritePtrs;
+    int fifoCount = 0;
+};
@@ -0,0 +1,370 @@
+#include "ModelSwap.h"
+#include "ModelBlobJson.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+// One thread loads models for every instance in the process. The first ModelSwap starts it,
+// the last one stops it, and in between it sleeps until a load is queued.
+class ModelSwap::Loader
+{
+public:
+    static void attach()
+    {
+        auto& loader = get();
+        std::unique_lock<std::mutex> lock(loader.mutex);
+
+        // The last user of the previous thread may still be joining it
+        loader.idle.wait(lock, [&] { return !loader.stopping; });
+
+        if (loader.numUsers++ == 0) {
+            loader.quit = false;
+            loader.thread = std::thread([&loader] { loader.run(); });
+        }
+    }
+
+    // Drops any queued work for swap and waits for a load it is running to finish
+    static void detach(ModelSwap& swap)
+    {
+        auto& loader = get();
+        std::unique_lock<std::mutex> lock(loader.mutex);
+        loader.queue.erase(std::remove(loader.queue.begin(), loader.queue.end(), &swap), loader.queue.end());
+        loader.idle.wait(lock, [&] { return loader.running != &swap; });
+
+        if (--loader.numUsers > 0)
+            return;
+
+        // Joined outside the lock; attach() holds off until the old thread has gone, so it
+        // can neither replace a joinable thread nor keep this one running
+        loader.quit = true;
+        loader.stopping = true;
+        std::thread old = std::move(loader.thread);
+        lock.unlock();
+        loader.wake.notify_one();
+        old.join();
+
+        lock.lock();
+        loader.stopping = false;
+        loader.idle.notify_all();
+    }
+
+    static void post(ModelSwap& swap)
+    {
+        auto& loader = get();
+        {
+            const std::lock_guard<std::mutex> lock(loader.mutex);
+            if (std::find(loader.queue.begin(), loader.queue.end(), &swap) != loader.queue.end())
+                return;
+            loader.queue.push_back(&swap);
+        }
+        loader.wake.notify_one();
+    }
+
+private:
+    static Loader& get()
+    {
+        static Loader loader;
+        return loader;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this] { return quit || !queue.empty(); });
+            if (quit)
+                return;
+
+            running = queue.front();
+            queue.pop_front();
+
+            lock.unlock();
+            running->service();
+            lock.lock();
+
+            running = nullptr;
+            idle.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<ModelSwap*> queue;
+    ModelSwap* running = nullptr;
+    int numUsers = 0;
+    bool quit = false, stopping = false;
+    std::thread thread;
+};
+
+ModelSwap::ModelSwap(const void* defaultBlobToUse, size_t defaultBlobSizeToUse)
+    : defaultBlob(defaultBlobToUse), defaultBlobSize(defaultBlobSizeToUse), active(std::make_unique<RT_LSTM>())
+{
+    const bool modelLoaded = active->load_binary(defaultBlob, defaultBlobSize);
+    (void) modelLoaded;
+
+    Loader::attach();
+}
+
+ModelSwap::~ModelSwap()
+{
+    Loader::detach(*this);
+
+    delete pending.exchange(nullptr);
+    delete unretired;
+    reclaim();
+}
+
+bool ModelSwap::adoptPending()
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    RT_LSTM* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (next == nullptr)
+        return false;
+
+    active.reset(next);
+    return true;
+}
+
+void ModelSwap::prepare(int numChannels, int maxBlockSize, int crossfadeSamplesToUse, float drive)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    setDrive(drive);
+
+    config.numChannels = std::max(1, numChannels);
+    config.maxBlockSize = std::max(1, maxBlockSize);
+
+    // Audio is stopped, so a crossfade still running can simply end here
+    fadingOut.reset();
+    delete unretired;
+    unretired = nullptr;
+    reclaim();
+
+    crossfadeSamples = std::max(0, crossfadeSamplesToUse);
+    crossfadePosition = 0;
+    fadeBlockSize = config.maxBlockSize;
+    fadeData.assign((size_t) config.numChannels * (size_t) fadeBlockSize, 0.0f);
+    fadeChannels.resize((size_t) config.numChannels);
+    for (int ch = 0; ch < config.numChannels; ++ch)
+        fadeChannels[(size_t) ch] = fadeData.data() + (size_t) ch * (size_t) fadeBlockSize;
+    chunkIn.resize((size_t) config.numChannels);
+    chunkOut.resize((size_t) config.numChannels);
+
+    // The worker only publishes while holding the lock, so pending cannot change under us
+    ready(*active, config);
+    if (auto* next = pending.load(std::memory_order_acquire))
+        ready(*next, config);
+}
+
+void ModelSwap::load(const std::string& path)
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        requestedPath = path;
+        hasRequest = true;
+        loading.store(true, std::memory_order_relaxed);
+    }
+    Loader::post(*this);
+}
+
+std::string ModelSwap::getModelPath() const
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    return loading.load(std::memory_order_relaxed) ? requestedPath : modelPath;
+}
+
+std::string ModelSwap::getLastError() const
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    return lastError;
+}
+
+void ModelSwap::service()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (hasRequest) {
+        const std::string path = requestedPath;
+        hasRequest = false;
+
+        // Reading, packing and warming up need no shared state, so the message thread is not
+        // held up by them. A model warmed up for a configuration prepare() has since replaced
+        // is warmed up again.
+        lock.unlock();
+        std::string error;
+        auto model = build(path, error);
+        lock.lock();
+
+        while (model != nullptr && !hasRequest) {
+            const Config readied = config;
+            lock.unlock();
+            ready(*model, readied);
+            lock.lock();
+
+            if (readied.numChannels == config.numChannels && readied.maxBlockSize == config.maxBlockSize)
+                break;
+        }
+
+        // Dropped if a newer request came in meanwhile
+        if (model != nullptr && !hasRequest) {
+            // Whatever was still pending has never been seen by the audio thread
+            delete pending.exchange(model.release(), std::memory_order_acq_rel);
+            modelPath = path;
+        }
+
+        lastError = error;
+        loading.store(hasRequest, std::memory_order_relaxed);
+    }
+}
+
+std::unique_ptr<RT_LSTM> ModelSwap::build(const std::string& path, std::string& error) const
+{
+    std::vector<char> bytes;
+    if (path.empty()) {
+        const auto* begin = static_cast<const char*>(defaultBlob);
+        bytes.assign(begin, begin + defaultBlobSize);
+    } else {
+        std::ifstream file(std::filesystem::path(reinterpret_cast<const char8_t*>(path.c_str())), std::ios::binary);
+        if (!file) {
+            error = "Cannot open " + path;
+            return nullptr;
+        }
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // Anything that is not already a packed blob is taken to be the training JSON
+    try {
+        if (bytes.size() < 4 || std::memcmp(bytes.data(), "PDMB", 4) != 0)
+            bytes = ModelBlob::fromJson(nlohmann::json::parse(bytes.begin(), bytes.end()));
+    } catch (const std::exception& e) {
+        error = e.what();
+        return nullptr;
+    }
+
+    auto model = std::make_unique<RT_LSTM>();
+    if (!model->load_binary(bytes.data(), bytes.size())) {
+        error = "Corrupt model or unsupported architecture";
+        return nullptr;
+    }
+
+    return model;
+}
+
+void ModelSwap::ready(RT_LSTM& model, const Config& target) const
+{
+    // Not prepared yet: prepare() readies the model once the configuration is known
+    if (target.numChannels == 0)
+        return;
+
+    model.prepare(target.numChannels, target.maxBlockSize);
+
+    // Start from the rest state silence would have settled it in, then run one block so the
+    // weights and state are in cache when the audio thread takes over
+    const float drive = startDrive.load(std::memory_order_relaxed);
+    model.resetToRest(drive);
+
+    std::vector<float> silence((size_t) target.maxBlockSize, 0.0f);
+    std::vector<float> output((size_t) target.numChannels * (size_t) target.maxBlockSize);
+    std::vector<const float*> in((size_t) target.numChannels, silence.data());
+    std::vector<float*> out((size_t) target.numChannels);
+    for (int ch = 0; ch < target.numChannels; ++ch)
+        out[(size_t) ch] = output.data() + (size_t) ch * (size_t) target.maxBlockSize;
+
+    model.process(in.data(), out.data(), target.numChannels, drive, target.maxBlockSize);
+}
+
+bool ModelSwap::retire(RT_LSTM* model) noexcept
+{
+    for (auto& slot : retired) {
+        RT_LSTM* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, model, std::memory_order_release, std::memory_order_relaxed))
+            return true;
+    }
+
+    return false;
+}
+
+void ModelSwap::reclaim() noexcept
+{
+    for (auto& slot : retired)
+        delete slot.exchange(nullptr, std::memory_order_acquire);
+}
+
+bool ModelSwap::acquire() noexcept
+{
+    // A model faded out while every retired slot was taken goes first
+    if (unretired != nullptr) {
+        if (!retire(unretired))
+            return false;
+        unretired = nullptr;
+    }
+
+    // One crossfade at a time; the next model waits for this one to finish
+    if (fadingOut != nullptr || pending.load(std::memory_order_relaxed) == nullptr)
+        return false;
+
+    RT_LSTM* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (next == nullptr)
+        return false;
+
+    fadingOut = std::move(active);
+    active.reset(next);
+    crossfadePosition = 0;
+
+    if (crossfadeSamples == 0 || fadeBlockSize == 0) {
+        unretired = fadingOut.release();
+        if (retire(unretired))
+            unretired = nullptr;
+    }
+
+    return true;
+}
+
+void ModelSwap::process(const float* const* inData, float* const* outData, int numChannels, float driveParam, int numSamples, OutputStage* outputStage) noexcept
+{
+    if (fadingOut == nullptr) {
+        active->process(inData, outData, numChannels, driveParam, numSamples, outputStage);
+        return;
+    }
+
+    // Both models see the same input; the old one runs first because the new one may be
+    // writing over it in place. The models are close relatives, so the fade is linear.
+    numChannels = std::min(numChannels, (int) fadeChannels.size());
+    for (int start = 0; start < numSamples; start += fadeBlockSize) {
+        const int blockSize = std::min(fadeBlockSize, numSamples - start);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            chunkIn[(size_t) ch] = inData[ch] + start;
+            chunkOut[(size_t) ch] = outData[ch] + start;
+        }
+
+        fadingOut->process(chunkIn.data(), fadeChannels.data(), numChannels, driveParam, blockSize);
+        active->process(chunkIn.data(), chunkOut.data(), numChannels, driveParam, blockSize);
+
+        const float step = 1.0f / (float) crossfadeSamples;
+        for (int ch = 0; ch < numChannels; ++ch) {
+            const float* faded = fadeChannels[(size_t) ch];
+            float* out = chunkOut[(size_t) ch];
+            for (int i = 0; i < blockSize; ++i) {
+                const float gain = std::min(1.0f, (float) (crossfadePosition + i + 1) * step);
+                out[i] = faded[i] + gain * (out[i] - faded[i]);
+            }
+        }
+
+        crossfadePosition += blockSize;
+    }
+
+    if (crossfadePosition >= crossfadeSamples) {
+        unretired = fadingOut.release();
+        if (retire(unretired))
+            unretired = nullptr;
+    }
+
+    if (outputStage != nullptr)
+        outputStage->process(outData, numChannels, numSamples);
+}
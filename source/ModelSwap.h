@@ -0,0 +1,107 @@
+#pragma once
+
+#include "RTNeuralLSTM.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Owns the running model and replaces it without ever blocking the audio thread. A model
+// file is read, parsed, packed, prepared and warmed up on a loader thread shared by every
+// instance in the process, then published through one atomic pointer. The audio thread
+// picks it up at the start of a block and crossfades from the old model, which is handed
+// back to be deleted by reclaim().
+class ModelSwap
+{
+public:
+    // Loads the fallback model (normally the embedded blob) synchronously. The bytes must
+    // outlive this object.
+    ModelSwap(const void* defaultBlob, size_t defaultBlobSize);
+    ~ModelSwap();
+
+    // Message thread with audio stopped: a model waiting to take over does so straight away,
+    // without a crossfade. Returns true when the running model changed.
+    bool adoptPending();
+
+    // Message thread with audio stopped: prepares the running model and any model waiting
+    // to be picked up at the rest state for drive, and sets the configuration new models
+    // are built for.
+    void prepare(int numChannels, int maxBlockSize, int crossfadeSamples, float drive);
+
+    // Any thread: the drive parameter as the caller last set it, which models loaded from
+    // now on warm up and settle at
+    void setDrive(float drive) noexcept { startDrive.store(drive, std::memory_order_relaxed); }
+
+    // Message thread: queues a model file (the training .json or a packed .bin) for loading.
+    // An empty path goes back to the default model. A request the loader has not started
+    // yet is replaced by a newer one.
+    void load(const std::string& path);
+
+    // Path of the model being loaded, or else of the one that loaded last (empty for the
+    // default), and why the last request failed (empty if it did not)
+    std::string getModelPath() const;
+    std::string getLastError() const;
+    bool isLoading() const noexcept { return loading.load(std::memory_order_relaxed); }
+
+    // Message thread: deletes the models the audio thread has finished with. Call it
+    // periodically; the audio thread stops swapping while all the retired slots are full.
+    void reclaim() noexcept;
+
+    // Audio thread, start of a block: takes a published model and starts the crossfade.
+    // Returns true when the running model changed, so per-model settings can be reapplied.
+    bool acquire() noexcept;
+
+    RT_LSTM& current() noexcept { return *active; }
+    const RT_LSTM& current() const noexcept { return *active; }
+
+    // Same contract as RT_LSTM::process(). During a crossfade both models run and the
+    // output stage is applied to the mix.
+    void process(const float* const* inData, float* const* outData, int numChannels, float driveParam, int numSamples, OutputStage* outputStage = nullptr) noexcept;
+
+private:
+    struct Config
+    {
+        int numChannels = 0;
+        int maxBlockSize = 0;
+    };
+
+    class Loader;
+
+    void service();
+    std::unique_ptr<RT_LSTM> build(const std::string& path, std::string& error) const;
+    void ready(RT_LSTM& model, const Config& target) const;
+    bool retire(RT_LSTM* model) noexcept;
+
+    const void* defaultBlob;
+    size_t defaultBlobSize;
+
+    // Audio thread (or message thread while stopped)
+    std::unique_ptr<RT_LSTM> active;
+    std::unique_ptr<RT_LSTM> fadingOut; // previous model while the crossfade runs
+    RT_LSTM* unretired = nullptr;       // faded out, waiting for a free retired slot
+    int crossfadeSamples = 0;
+    int crossfadePosition = 0;
+    int fadeBlockSize = 0;
+    std::vector<float> fadeData;        // fadingOut's output, fadeBlockSize per channel
+    std::vector<float*> fadeChannels;
+    std::vector<const float*> chunkIn;
+    std::vector<float*> chunkOut;
+
+    // Loader -> audio thread: newest model ready to run
+    std::atomic<RT_LSTM*> pending { nullptr };
+    // Audio thread -> reclaim(): models to delete
+    std::array<std::atomic<RT_LSTM*>, 4> retired {};
+    // Drive new models warm up at, so they start where the running one is heading
+    std::atomic<float> startDrive { 0.5f };
+
+    // Loader state, guarded by mutex
+    mutable std::mutex mutex;
+    Config config;
+    std::string requestedPath;
+    bool hasRequest = false;
+    std::string modelPath;
+    std::string lastError;
+    std::atomic<bool> loading { false };
+};
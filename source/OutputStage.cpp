@@ -0,0 +1,104 @@
+#include "OutputStage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+void OutputStage::prepare(int numChannels, double sampleRate)
+{
+    tone.prepare(numChannels, BiquadCascade::maxSections);
+    preparedSampleRate = sampleRate;
+    setRampDurationSeconds(rampSeconds);
+}
+
+void OutputStage::reset()
+{
+    tone.reset();
+
+    gain = gainTarget;
+    gainStep = 0.0f;
+    gainRampRemaining = 0;
+}
+
+void OutputStage::setRampDurationSeconds(double rampDurationSeconds) noexcept
+{
+    rampSeconds = rampDurationSeconds;
+    gainRampLength = (int) std::floor(rampSeconds * preparedSampleRate);
+    reset();
+}
+
+void OutputStage::setGainDecibels(float gainDecibels) noexcept
+{
+    // Called every block: only an exactly unchanged target is a no-op, as juce::exactlyEqual does it
+    const float newTarget = gainDecibels > -100.0f ? std::pow(10.0f, gainDecibels * 0.05f) : 0.0f;
+    if (std::equal_to<float>()(newTarget, gainTarget))
+        return;
+
+    gainTarget = newTarget;
+    if (gainRampLength > 0) {
+        gainStep = (gainTarget - gain) / (float) gainRampLength;
+        gainRampRemaining = gainRampLength;
+    } else {
+        gain = gainTarget;
+        gainStep = 0.0f;
+        gainRampRemaining = 0;
+    }
+}
+
+template <int numLanes>
+void OutputStage::processGroup(int groupIndex, float* const* channels, int numChannels, int numSamples) noexcept
+{
+    float* const* data = channels + tone.getGroup(groupIndex).firstChannel;
+    GroupRunner<numLanes> runner(*this, groupIndex);
+
+    for (int i = 0; i < numSamples; ++i) {
+        float x[(size_t) numLanes] {};
+        for (int l = 0; l < numChannels; ++l)
+            x[l] = data[l][i];
+
+        runner.processSample(x, i);
+
+        for (int l = 0; l < numChannels; ++l)
+            data[l][i] = x[l];
+    }
+}
+
+void OutputStage::process(float* const* channels, int numChannels, int numSamples) noexcept
+{
+    for (int g = 0; g < tone.getNumGroups(); ++g) {
+        const auto& group = tone.getGroup(g);
+        if (group.firstChannel >= numChannels)
+            break;
+
+        // A group only partly covered by the buffer runs its missing lanes on silence
+        const int groupChannels = std::min(group.numLanes, numChannels - group.firstChannel);
+
+        switch (group.numLanes) {
+            case 8:
+                processGroup<8>(g, channels, groupChannels, numSamples);
+                break;
+            case 4:
+                processGroup<4>(g, channels, groupChannels, numSamples);
+                break;
+            case 2:
+                processGroup<2>(g, channels, groupChannels, numSamples);
+                break;
+            default:
+                processGroup<1>(g, channels, groupChannels, numSamples);
+                break;
+        }
+    }
+
+    endBlock(numSamples);
+}
+
+void OutputStage::endBlock(int numSamples) noexcept
+{
+    tone.advance(numSamples);
+
+    if (gainRampRemaining > 0) {
+        const int steps = std::min(numSamples, gainRampRemaining);
+        gainRampRemaining -= steps;
+        gain = gainRampRemaining > 0 ? gain + gainStep * (float) steps : gainTarget;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BiquadCascade.h"
+
+// Everything applied after the model: the tone cascade, then the output gain.
+// RT_LSTM runs it on each sample it produces while the sample is still in
+// registers (after adding the skip connection), so the buffer is written once.
+class OutputStage
+{
+public:
+    void prepare(int numChannels, double sampleRate);
+    void reset();
+
+    BiquadCascade& getTone() noexcept { return tone; }
+    int getNumChannels() const noexcept { return tone.getNumChannels(); }
+
+    // Linear gain glide over rampDurationSeconds, matching juce::dsp::Gain
+    void setRampDurationSeconds(double rampDurationSeconds) noexcept;
+    void setGainDecibels(float gainDecibels) noexcept;
+
+    // Unfused path for buffers that did not come from RT_LSTM. Closes the block. Same channel
+    // rules as BiquadCascade::process().
+    void process(float* const* channels, int numChannels, int numSamples) noexcept;
+
+    // Per-sample access for one lane group. Run every group over the block, then endBlock().
+    // Target as in BiquadCascade::GroupRunner.
+    template <int numLanes, typename Target = void>
+    class GroupRunner
+    {
+    public:
+        GroupRunner(OutputStage& stageToUse, int groupIndex) noexcept
+            : tone(stageToUse.tone, groupIndex),
+              gain(stageToUse.gain),
+              gainTarget(stageToUse.gainTarget),
+              gainStep(stageToUse.gainStep),
+              gainRampRemaining(stageToUse.gainRampRemaining)
+        {
+        }
+
+        // x holds one sample per lane; sampleIndex is relative to the start of the block
+        void processSample(float* x, int sampleIndex) noexcept
+        {
+            tone.processSample(x, sampleIndex);
+
+            // Inlined here rather than shared, so each Target gets its own copy
+            const float g = gainRampRemaining > sampleIndex ? gain + gainStep * (float) (sampleIndex + 1) : gainTarget;
+            for (int l = 0; l < numLanes; ++l)
+                x[l] *= g;
+        }
+
+    private:
+        BiquadCascade::GroupRunner<numLanes, Target> tone;
+        const float gain, gainTarget, gainStep;
+        const int gainRampRemaining;
+    };
+
+    void endBlock(int numSamples) noexcept;
+
+private:
+    template <int numLanes>
+    void processGroup(int groupIndex, float* const* channels, int numChannels, int numSamples) noexcept;
+
+    BiquadCascade tone;
+
+    float gain = 1.0f;
+    float gainTarget = 1.0f;
+    float gainStep = 0.0f;
+    int gainRampRemaining = 0;
+    int gainRampLength = 0;
+    double preparedSampleRate = 44100.0;
+    double rampSeconds = 0.0;
+};
@@ -0,0 +1,122 @@
+#include "PerfMonitor.h"
+
+#include <algorithm>
+#include <filesystem>
+
+static std::atomic<uint32_t> nextInstanceId { 1 };
+
+const char* PerfMonitor::getStageName(int stage) noexcept
+{
+    static const char* const names[numStages] = { "control", "resampling", "inference", "output" };
+    return stage >= 0 && stage < numStages ? names[stage] : "";
+}
+
+PerfMonitor::PerfMonitor() : instanceId(nextInstanceId.fetch_add(1, std::memory_order_relaxed)), ring((size_t) ringSize)
+{
+    window.reserve((size_t) windowSize);
+    scratch.reserve((size_t) windowSize);
+}
+
+PerfMonitor::~PerfMonitor()
+{
+    stopTrace();
+}
+
+void PerfMonitor::beginBlock(int numSamples) noexcept
+{
+    lastMark = clock();
+    current = {};
+    current.time = lastMark;
+    current.numSamples = (uint32_t) numSamples;
+    current.deadlineNanos = (float) (numSamples * nanosPerSample);
+}
+
+void PerfMonitor::endBlock(uint32_t flags) noexcept
+{
+    current.totalNanos = (float) (clock() - current.time);
+    current.flags = flags;
+    if (current.totalNanos > current.deadlineNanos) {
+        current.flags |= deadlineMissed;
+        deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A full ring means nobody is collecting; the newest records are the ones lost
+    const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+    if (write - readIndex.load(std::memory_order_acquire) >= (uint64_t) ringSize) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring[(size_t) (write % ringSize)] = current;
+    writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void PerfMonitor::collect()
+{
+    uint64_t read = readIndex.load(std::memory_order_relaxed);
+    const uint64_t write = writeIndex.load(std::memory_order_acquire);
+
+    for (; read != write; ++read) {
+        const Record& record = ring[(size_t) (read % ringSize)];
+        if (trace.is_open())
+            trace.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+
+        if ((int) window.size() < windowSize) {
+            window.push_back(record);
+        } else {
+            window[(size_t) windowPosition] = record;
+            windowPosition = (windowPosition + 1) % windowSize;
+        }
+    }
+    readIndex.store(read, std::memory_order_release);
+
+    if (trace.is_open())
+        trace.flush();
+
+    // Shares of the deadline, so blocks of different sizes compare
+    auto load = [this](auto nanos) {
+        scratch.clear();
+        for (const auto& record : window)
+            scratch.push_back(record.deadlineNanos > 0.0f ? nanos(record) / record.deadlineNanos : 0.0f);
+
+        Load result;
+        if (scratch.empty())
+            return result;
+
+        const auto at = [this](double quantile) {
+            auto nth = scratch.begin() + (ptrdiff_t) (quantile * (double) (scratch.size() - 1));
+            std::nth_element(scratch.begin(), nth, scratch.end());
+            return *nth;
+        };
+        result.p50 = at(0.5);
+        result.p99 = at(0.99);
+        result.max = *std::max_element(scratch.begin(), scratch.end());
+        return result;
+    };
+
+    for (int stage = 0; stage < numStages; ++stage)
+        stats.stages[stage] = load([stage](const Record& record) { return record.stageNanos[stage]; });
+    stats.total = load([](const Record& record) { return record.totalNanos; });
+    stats.numBlocks = (int) window.size();
+    stats.deadlineMisses = deadlineMisses.load(std::memory_order_relaxed);
+    stats.droppedRecords = droppedRecords.load(std::memory_order_relaxed);
+}
+
+bool PerfMonitor::startTrace(const std::string& path)
+{
+    stopTrace();
+    trace.open(std::filesystem::path(reinterpret_cast<const char8_t*>(path.c_str())), std::ios::binary | std::ios::trunc);
+    if (!trace)
+        return false;
+
+    const uint32_t header[] = { 1, (uint32_t) sizeof(Record), (uint32_t) numStages, instanceId };
+    trace.write("PDTR", 4);
+    trace.write(reinterpret_cast<const char*>(header), sizeof(header));
+    return (bool) trace;
+}
+
+void PerfMonitor::stopTrace()
+{
+    if (trace.is_open())
+        trace.close();
+}
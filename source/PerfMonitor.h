@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Times every processed block stage by stage. The audio thread only reads the clock and
+// writes fixed-size records into a preallocated single-producer ring; a non-realtime
+// thread drains it with collect(), keeps rolling percentiles over the last blocks and
+// optionally appends the raw records to a trace file.
+//
+// Trace file layout (little-endian): the magic "PDTR", then uint32 version, record size,
+// number of stages and instance id, then one Record per block until the trace is stopped.
+class PerfMonitor
+{
+public:
+    // A stage is charged the time since the previous mark, so marks go at stage ends
+    enum Stage
+    {
+        Control = 0, // parameter smoothing, model hand-over, tone coefficients
+        Resampling,  // conversion to and from the model rate
+        Inference,   // the model, with the tone controls and gain fused in when not resampling
+        Output,      // tone controls and gain in their own pass, after resampling
+        numStages
+    };
+
+    static const char* getStageName(int stage) noexcept;
+
+    enum Flags : uint32_t
+    {
+        deadlineMissed = 1u << 0,
+        modelAsleep = 1u << 1,
+        resampled = 1u << 2
+    };
+
+    struct Record
+    {
+        uint64_t time;       // block start, nanoseconds since the monitor was created
+        uint32_t numSamples;
+        uint32_t flags;
+        float deadlineNanos; // duration of the block's audio
+        float stageNanos[numStages];
+        float totalNanos;
+    };
+    static_assert(sizeof(Record) == 40, "trace records are read back by size");
+
+    // Percentiles of a stage's share of the block deadline (1 = the whole block)
+    struct Load
+    {
+        float p50 = 0.0f, p99 = 0.0f, max = 0.0f;
+    };
+
+    struct Stats
+    {
+        Load stages[numStages];
+        Load total;
+        int numBlocks = 0;            // blocks in the rolling window
+        uint64_t deadlineMisses = 0;  // since the monitor was created
+        uint64_t droppedRecords = 0;  // ring overflows, when nothing collected for a while
+    };
+
+    PerfMonitor();
+    ~PerfMonitor();
+
+    // Distinguishes plugin instances in the readout and trace file names
+    uint32_t getInstanceId() const noexcept { return instanceId; }
+
+    // Audio stopped
+    void prepare(double sampleRate) noexcept { nanosPerSample = 1.0e9 / sampleRate; }
+
+    // Audio thread: beginBlock(), a mark() at the end of each stage that ran, endBlock()
+    void beginBlock(int numSamples) noexcept;
+    void mark(Stage stage) noexcept
+    {
+        const uint64_t now = clock();
+        current.stageNanos[stage] += (float) (now - lastMark);
+        lastMark = now;
+    }
+    void endBlock(uint32_t flags) noexcept;
+
+    // Non-realtime, one thread: drains the ring into the window and the trace
+    void collect();
+    const Stats& getStats() const noexcept { return stats; }
+
+    // Same thread as collect(). Returns false if the file cannot be created.
+    bool startTrace(const std::string& path);
+    void stopTrace();
+    bool isTracing() const noexcept { return trace.is_open(); }
+
+    static constexpr int ringSize = 4096;   // about 45 s of 512-sample blocks at 44.1 kHz
+    static constexpr int windowSize = 1024; // blocks the percentiles are taken over
+
+private:
+    uint64_t clock() const noexcept
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    const uint32_t instanceId;
+    double nanosPerSample = 1.0e9 / 44100.0;
+
+    // Audio thread
+    Record current {};
+    uint64_t lastMark = 0;
+
+    // Audio thread -> collector
+    std::vector<Record> ring;
+    std::atomic<uint64_t> writeIndex { 0 };
+    std::atomic<uint64_t> readIndex { 0 };
+    std::atomic<uint64_t> deadlineMisses { 0 };
+    std::atomic<uint64_t> droppedRecords { 0 };
+
+    // Collector
+    std::vector<Record> window;
+    int windowPosition = 0;
+    std::vector<float> scratch;
+    Stats stats;
+    std::ofstream trace;
+};
@@ -1,74 +1,423 @@
 #include "RTNeuralLSTM.h"
+#include "ModelBlobJson.h"
 
-using Vec2d = std::vector<std::vector<float>>;
+#include <cmath>
+#include <functional>
+#include <map>
+#include <mutex>
 
-Vec2d transpose(const Vec2d& x)
+// Rest states: a drive step has settled once a block of silence moves no state value by more
+// than this. Rounding alone keeps some models' state jittering at a few 1e-6.
+static constexpr float restTolerance = 1.0e-5f;
+static constexpr int restBlockSize = 64;
+static constexpr int maxRestSamples = 1 << 16;
+
+// Parameter values are compared exactly to tell whether they moved, as juce::exactlyEqual does
+static bool exactlyEqual(float a, float b) noexcept
+{
+    return std::equal_to<float>()(a, b);
+}
+
+void RT_LSTM::load_json(const nlohmann::json& weights_json)
+{
+    const auto blob = ModelBlob::fromJson(weights_json);
+    load_binary(blob.data(), blob.size());
+}
+
+bool RT_LSTM::load_binary(const void* data, size_t size)
 {
-    auto outer_size = x.size();
-    auto inner_size = x[0].size();
-    Vec2d y(inner_size, std::vector<float>(outer_size, 0.0f));
+    return loadWeights(LSTMWeights::fromBinary(data, size));
+}
+
+bool RT_LSTM::loadWeights(std::shared_ptr<const LSTMWeights> newWeights)
+{
+    if (newWeights == nullptr || !LSTMKernels::supports(newWeights->unitType, newWeights->hiddenSize, newWeights->numLayers))
+        return false;
+
+    const bool sameArchitecture = weights != nullptr && weights->unitType == newWeights->unitType
+                                  && weights->hiddenSize == newWeights->hiddenSize && weights->numLayers == newWeights->numLayers;
+
+    weights = std::move(newWeights);
+    if (!sameArchitecture)
+        allocateState();
+
+    foldDrive(previousDrive);
+    silentSamples = 0;
+    sleeping = false;
+    return true;
+}
+
+bool RT_LSTM::setKernel(LSTMKernels::Variant variant) noexcept
+{
+    const auto* newKernel = LSTMKernels::get(variant);
+    if (newKernel == nullptr)
+        return false;
+
+    kernel = newKernel;
+    return true;
+}
+
+void RT_LSTM::reset()
+{
+    for (auto& group : groups) {
+        for (int l = 0; l < maxLayers; ++l) {
+            std::fill(group.hidden[l].begin(), group.hidden[l].end(), 0.0f);
+            std::fill(group.cell[l].begin(), group.cell[l].end(), 0.0f);
+        }
+    }
+
+    silentSamples = 0;
+    sleeping = false;
+}
+
+RT_LSTM::State RT_LSTM::captureState(int channel) const
+{
+    State state;
+    for (const auto& group : groups) {
+        if (channel < group.firstChannel || channel >= group.firstChannel + group.numLanes)
+            continue;
+
+        const int lane = channel - group.firstChannel;
+        for (int l = 0; l < maxLayers; ++l)
+            for (const auto* vector : { &group.hidden[l], &group.cell[l] })
+                for (size_t j = (size_t) lane; j < vector->size(); j += (size_t) group.numLanes)
+                    state.values.push_back((*vector)[j]);
+    }
+    return state;
+}
+
+bool RT_LSTM::restoreState(const State& state) noexcept
+{
+    for (const auto& group : groups) {
+        size_t size = 0;
+        for (int l = 0; l < maxLayers; ++l)
+            size += (group.hidden[l].size() + group.cell[l].size()) / (size_t) group.numLanes;
+        if (size != state.values.size())
+            return false;
+    }
+
+    for (auto& group : groups) {
+        auto value = state.values.begin();
+        for (int l = 0; l < maxLayers; ++l)
+            for (auto* vector : { &group.hidden[l], &group.cell[l] })
+                for (size_t j = 0; j < vector->size(); j += (size_t) group.numLanes, ++value)
+                    std::fill_n(vector->begin() + (ptrdiff_t) j, group.numLanes, *value);
+    }
+
+    silentSamples = 0;
+    sleeping = false;
+    return true;
+}
+
+RT_LSTM::State RT_LSTM::getRestState(float drive) const
+{
+    if (weights == nullptr)
+        return {};
+
+    const int step = (int) std::lround(std::clamp(drive, 0.0f, 1.0f) * (float) (numRestDrives - 1));
+    drive = (float) step / (float) (numRestDrives - 1);
+
+    // One table per live model, dropped with its weights; steps are filled as they are asked for.
+    // The lock only guards the table, so loads on other threads never wait on the inference
+    // below; two threads asking for the same new step both compute it and the first one wins.
+    static std::mutex mutex;
+    static std::map<const LSTMWeights*, std::pair<std::weak_ptr<const LSTMWeights>, std::vector<State>>> store;
 
-    for (size_t i = 0; i < outer_size; ++i)
     {
-        for (size_t j = 0; j < inner_size; ++j)
-            y[j][i] = x[i][j];
+        const std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = store.begin(); it != store.end();)
+            it = it->second.first.expired() ? store.erase(it) : std::next(it);
+
+        const auto found = store.find(weights.get());
+        if (found != store.end() && !found->second.second[(size_t) step].values.empty())
+            return found->second.second[(size_t) step];
     }
 
-    return y;
+    // Exact inference on one channel until a block of silence no longer moves the state
+    RT_LSTM model;
+    model.loadWeights(weights);
+    model.prepare(1, restBlockSize);
+    model.previousDrive = drive;
+
+    std::vector<float> silence((size_t) restBlockSize, 0.0f), output((size_t) restBlockSize);
+    const float* in = silence.data();
+    float* out = output.data();
+
+    auto previous = model.captureState();
+    for (int done = 0; done < maxRestSamples; done += restBlockSize) {
+        model.process(&in, &out, 1, drive, restBlockSize);
+        auto current = model.captureState();
+
+        float change = 0.0f;
+        for (size_t i = 0; i < current.values.size(); ++i)
+            change = std::max(change, std::abs(current.values[i] - previous.values[i]));
+        previous = std::move(current);
+        if (change <= restTolerance)
+            break;
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    auto& steps = store.try_emplace(weights.get(), weights, std::vector<State>((size_t) numRestDrives)).first->second.second;
+    auto& rest = steps[(size_t) step];
+    if (rest.values.empty())
+        rest = std::move(previous);
+    return rest;
 }
 
-void RT_LSTM::load_json(const nlohmann::json& weights_json)
+void RT_LSTM::resetToRest(float drive)
 {
-    auto& lstm = model.get<0>();
-    auto& dense = model.get<1>();
+    if (weights == nullptr) {
+        reset();
+        return;
+    }
 
-    Vec2d lstm_weights_ih = weights_json["/state_dict/rec.weight_ih_l0"_json_pointer];
-    lstm.setWVals(transpose(lstm_weights_ih));
+    drive = std::clamp(drive, 0.0f, 1.0f);
+    if (!restoreState(getRestState(drive)))
+        reset();
 
-    Vec2d lstm_weights_hh = weights_json["/state_dict/rec.weight_hh_l0"_json_pointer];
-    lstm.setUVals(transpose(lstm_weights_hh));
+    previousDrive = drive;
+    foldDrive(drive);
+}
 
-    std::vector<float> lstm_bias_ih = weights_json["/state_dict/rec.bias_ih_l0"_json_pointer];
-    std::vector<float> lstm_bias_hh = weights_json["/state_dict/rec.bias_hh_l0"_json_pointer];
-    for (int i = 0; i < 128; ++i)
-        lstm_bias_hh[i] += lstm_bias_ih[i];
-    lstm.setBVals(lstm_bias_hh);
+void RT_LSTM::setIdleDetection(float threshold, int holdSamples) noexcept
+{
+    idleThreshold = std::max(0.0f, threshold);
+    idleHoldSamples = std::max(0, holdSamples);
 
-    Vec2d dense_weights = weights_json["/state_dict/lin.weight"_json_pointer];
-    dense.setWeights(dense_weights);
+    if (idleThreshold <= 0.0f) {
+        silentSamples = 0;
+        sleeping = false;
+    }
+}
 
-    std::vector<float> dense_bias = weights_json["/state_dict/lin.bias"_json_pointer];
-    dense.setBias(dense_bias.data());
+void RT_LSTM::foldDrive(float drive) noexcept
+{
+    const auto& w = *weights;
+    const float* bias = w.layers[0].bias;
+    const float* wDrive = w.wDrive();
+    for (int k = 0; k < w.gatesSize; ++k)
+        foldedBias[(size_t) k] = bias[k] + wDrive[k] * drive;
+
+    foldedDrive = drive;
 }
 
-void RT_LSTM::reset()
+void RT_LSTM::prepare(int numChannels, int /*maxBlockSize*/)
 {
-    model.reset();
+    numChannels = std::max(1, numChannels);
+    if (numChannels == numPreparedChannels && !groups.empty()) {
+        reset();
+        return;
+    }
+
+    numPreparedChannels = numChannels;
+
+    groups.clear();
+    for (const auto& layout : LaneLayout::split(numPreparedChannels)) {
+        LaneGroup group;
+        group.firstChannel = layout.firstChannel;
+        group.numLanes = layout.numLanes;
+        groups.push_back(std::move(group));
+    }
+
+    allocateState();
 }
 
-void RT_LSTM::process(const float* inData, float* outData, float driveParam, int numSamples)
+void RT_LSTM::allocateState()
 {
-    // Check for parameter changes for smoothing calculations
-    if (driveParam != previousDrive) {
-        steppedValue = (driveParam - previousDrive) / numSamples;
-        changedValue = true;
-    } else {
-        changedValue = false;
+    const int hiddenSize = weights != nullptr ? weights->hiddenSize : 0;
+    const int gatesSize = weights != nullptr ? weights->gatesSize : 0;
+    const int numLayers = weights != nullptr ? weights->numLayers : 0;
+    const bool hasCell = weights != nullptr && weights->unitType == LSTMWeights::UnitType::LSTM;
+
+    for (auto& group : groups) {
+        for (int l = 0; l < maxLayers; ++l) {
+            const size_t layerSize = l < numLayers ? (size_t) hiddenSize * (size_t) group.numLanes : 0;
+            group.hidden[l].assign(layerSize, 0.0f);
+            group.cell[l].assign(hasCell ? layerSize : 0, 0.0f);
+        }
     }
-    
-    for (int i = 0; i < numSamples; ++i) {
-        inArray[0] = inData[i];
-        
-        // Perform ramped value calculations to smooth out sound
-        if (changedValue) {
-            inArray[1] = previousDrive + (i + 1) * steppedValue;
-        } else {
-            inArray[1] = driveParam;
+
+    // Refold at once: process() only refolds when the drive moves
+    foldedBias.assign((size_t) gatesSize, 0.0f);
+    if (weights != nullptr)
+        foldDrive(foldedDrive);
+
+    savedState.assign((size_t) (2 * numLayers * hiddenSize * numPreparedChannels), 0.0f);
+    restOutput.assign((size_t) numPreparedChannels, 0.0f);
+    silentSamples = 0;
+    sleeping = false;
+}
+
+bool RT_LSTM::isSilent(const float* const* inData, int numChannels, int numSamples) const noexcept
+{
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            if (std::abs(inData[ch][i]) >= idleThreshold)
+                return false;
+
+    return true;
+}
+
+void RT_LSTM::saveState() noexcept
+{
+    auto it = savedState.begin();
+    for (const auto& group : groups) {
+        for (int l = 0; l < maxLayers; ++l) {
+            it = std::copy(group.hidden[l].begin(), group.hidden[l].end(), it);
+            it = std::copy(group.cell[l].begin(), group.cell[l].end(), it);
+        }
+    }
+}
+
+bool RT_LSTM::stateSettled() const noexcept
+{
+    // Rounding keeps the recurrence jittering around its rest point at roughly -110 dB,
+    // so "not moving" is judged against the same threshold as the input
+    const float tolerance = idleThreshold;
+
+    auto it = savedState.begin();
+    for (const auto& group : groups)
+        for (int l = 0; l < maxLayers; ++l)
+            for (const auto* state : { &group.hidden[l], &group.cell[l] })
+                for (float value : *state)
+                    if (std::abs(value - *it++) > tolerance)
+                        return false;
+
+    return true;
+}
+
+void RT_LSTM::enterSleep() noexcept
+{
+    // Dense layer applied to the frozen hidden state of each lane's last layer
+    const auto& w = *weights;
+    for (const auto& group : groups) {
+        const auto& hidden = group.hidden[w.numLayers - 1];
+        for (int l = 0; l < group.numLanes; ++l) {
+            float out = w.denseBias;
+            for (int j = 0; j < w.hiddenSize; ++j)
+                out += w.denseWeights[j] * hidden[(size_t) (j * group.numLanes + l)];
+            restOutput[(size_t) (group.firstChannel + l)] = out;
         }
-        
-        outData[i] = model.forward(inArray) + inData[i];
     }
-    
-    previousDrive = driveParam;
-    
+
+    sleeping = true;
+}
+
+void RT_LSTM::process(const float* const* inData, float* const* outData, int numChannels, float driveParam, int numSamples, OutputStage* outputStage)
+{
+    // Only reached when the caller skipped prepare()
+    if (groups.empty())
+        prepare(numChannels, numSamples);
+
+    // Nothing loaded yet: leave the dry signal untouched
+    if (weights == nullptr) {
+        for (int ch = 0; ch < numChannels; ++ch)
+            if (outData[ch] != inData[ch])
+                std::copy(inData[ch], inData[ch] + numSamples, outData[ch]);
+
+        if (outputStage != nullptr)
+            outputStage->process(outData, numChannels, numSamples);
+        return;
+    }
+
+    // A new drive starts a glide from wherever the drive is now; previousDrive may also have
+    // been set directly, which glides to the current target
+    if (!exactlyEqual(driveParam, driveTarget)) {
+        driveTarget = driveParam;
+        driveRampRemaining = 0;
+    }
+    if (exactlyEqual(previousDrive, driveTarget))
+        driveRampRemaining = 0;
+    else if (driveRampRemaining == 0)
+        driveRampRemaining = driveRampSamples > 0 ? driveRampSamples : numSamples;
+    changedValue = driveRampRemaining > 0;
+
+    // Steady drive: its W_ih column lives in the folded bias
+    if (!changedValue && !exactlyEqual(driveParam, foldedDrive))
+        foldDrive(driveParam);
+
+    numChannels = std::min(numChannels, numPreparedChannels);
+
+    // Idle detection: any sample above threshold or a drive move wakes the model up
+    const bool silent = idleThreshold > 0.0f && !changedValue && isSilent(inData, numChannels, numSamples);
+    silentSamples = silent ? silentSamples + numSamples : 0;
+    sleeping = sleeping && silent;
+
+    if (sleeping) {
+        const float skip = weights->skipGain;
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                outData[ch][i] = restOutput[(size_t) ch] + skip * inData[ch][i];
+
+        previousDrive = driveParam;
+        if (outputStage != nullptr)
+            outputStage->process(outData, numChannels, numSamples);
+        return;
+    }
+
+    // Long enough in silence: sleep once a whole block leaves the state where it was
+    const bool sleepCandidate = silent && silentSamples >= idleHoldSamples;
+    if (sleepCandidate)
+        saveState();
+
+    // The stage's lane groups only line up with ours when both were prepared alike
+    OutputStage* fusedStage = outputStage != nullptr && outputStage->getNumChannels() == numPreparedChannels ? outputStage : nullptr;
+
+    LSTMKernels::GroupArgs args;
+    args.weights = weights.get();
+    args.foldedBias = foldedBias.data();
+    args.outputStage = fusedStage;
+
+    const auto runKernels = [&](int segmentStart, int segmentEnd) {
+        args.offset = segmentStart;
+        args.numSamples = segmentEnd - segmentStart;
+
+        for (int g = 0; g < (int) groups.size(); ++g) {
+            auto& group = groups[(size_t) g];
+            if (group.firstChannel >= numChannels)
+                break;
+
+            for (int l = 0; l < maxLayers; ++l) {
+                args.hidden[l] = group.hidden[l].data();
+                args.cell[l] = group.cell[l].data();
+            }
+            args.inData = inData + group.firstChannel;
+            args.outData = outData + group.firstChannel;
+            args.numChannels = std::min(group.numLanes, numChannels - group.firstChannel);
+            args.groupIndex = g;
+            kernel->find(weights->unitType, weights->hiddenSize, group.numLanes, eco, precision)(args);
+        }
+    };
+
+    // The glide runs with the drive per sample, whatever follows it on the folded bias
+    int segmentStart = 0;
+    if (driveRampRemaining > 0) {
+        const int rampLength = std::min(driveRampRemaining, numSamples);
+        steppedValue = (driveTarget - previousDrive) / (float) driveRampRemaining;
+
+        args.rampDrive = true;
+        args.previousDrive = previousDrive;
+        args.steppedValue = steppedValue;
+        runKernels(0, rampLength);
+
+        driveRampRemaining -= rampLength;
+        previousDrive = driveRampRemaining > 0 ? previousDrive + (float) rampLength * steppedValue : driveTarget;
+        segmentStart = rampLength;
+
+        if (driveRampRemaining == 0 && rampLength < numSamples)
+            foldDrive(driveTarget);
+    }
+
+    if (segmentStart < numSamples) {
+        args.rampDrive = false;
+        runKernels(segmentStart, numSamples);
+    }
+
+    if (sleepCandidate && stateSettled())
+        enterSleep();
+
+    if (fusedStage != nullptr)
+        fusedStage->endBlock(numSamples);
+    else if (outputStage != nullptr)
+        outputStage->process(outData, numChannels, numSamples);
 }
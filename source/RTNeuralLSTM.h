@@ -1,27 +1,168 @@
 #pragma once
 
+#include "LSTMKernels.h"
+#include "LSTMWeights.h"
+#include "LaneLayout.h"
+#include "OutputStage.h"
 #include <RTNeural/RTNeural.h>
+#include <algorithm>
 
 class RT_LSTM
 {
 public:
     RT_LSTM() = default;
 
+    // Channels are advanced together in groups of up to maxLanes, with the
+    // hidden/cell state of each group interleaved so one SIMD lane is one channel.
+    static constexpr int maxLanes = LaneLayout::maxLanes;
+
+    // Sizes the state and scratch for the channel count; preparing again for the same
+    // channels keeps the allocations. Either way the state is zeroed. Any block size can be
+    // processed: the input projection runs in fixed sub-blocks on the kernel's stack, so
+    // nothing scales with it.
+    void prepare(int numChannels, int maxBlockSize);
     void reset();
+
+    // Recurrent state of one channel: every layer's hidden and (LSTM) cell vector
+    struct State
+    {
+        std::vector<float> values;
+    };
+
+    // Copies one channel's state; allocates, so not for the audio thread
+    State captureState(int channel = 0) const;
+
+    // Gives every channel the same state, captured from a model of the same architecture.
+    // Allocation-free; returns false and changes nothing if the sizes do not match.
+    bool restoreState(const State& state) noexcept;
+
+    // Silence drives the model to a fixed point that depends on the drive: its rest state.
+    // Each DRIVE step (0.01) is settled once per model, on first use, and shared like the
+    // weights. Empty when nothing is loaded. Not for the audio thread.
+    static constexpr int numRestDrives = 101;
+    State getRestState(float drive) const;
+
+    // Like reset(), but to the rest state at the nearest drive step instead of zeros, with
+    // the drive already folded in: the first block continues as if it followed a long
+    // silence, without the start-up transient.
+    void resetToRest(float drive);
     void load_json(const nlohmann::json& weights_json);
 
-    void process(const float* inData, float* outData, float driveParam, int numSamples);
-    
+    // Loads a ModelBlob straight from embedded or memory-mapped bytes. The weights are
+    // shared with every other RT_LSTM that loaded the same blob; this instance only keeps
+    // its recurrent state and scratch. The blob header picks the architecture: LSTM or GRU,
+    // one or two layers, any hidden size in LSTMKernels::hiddenSizes. Returns false if the
+    // blob is corrupt or has no specialised kernel. Reallocates when the architecture
+    // changes, so not for the audio thread.
+    bool load_binary(const void* data, size_t size);
+
+    // Runs weights another instance already loaded, e.g. for measurements off the audio thread
+    bool loadWeights(std::shared_ptr<const LSTMWeights> newWeights);
+    std::shared_ptr<const LSTMWeights> getWeights() const noexcept { return weights; }
+
+    // Idle detection: once every input channel has stayed below threshold (linear peak) for
+    // holdSamples and the recurrent state has stopped moving (by more than threshold per
+    // block), inference is skipped and the model's rest output is written instead. The frozen
+    // state is the rest state, so waking up on the next loud sample continues exactly where
+    // the model would have been.
+    // A threshold of 0 disables it.
+    void setIdleDetection(float threshold, int holdSamples) noexcept;
+    bool isSleeping() const noexcept { return sleeping; }
+
+    // The per-sample kernels are picked from CPUID on construction (see LSTMKernels.h).
+    // Forcing a variant is meant for testing and benchmarks; it fails if the CPU cannot run it.
+    bool setKernel(LSTMKernels::Variant variant) noexcept;
+    const char* getKernelName() const noexcept { return kernel->name; }
+
+    // Eco mode swaps sigmoid/tanh for a rational approximation that vectorises, which
+    // takes roughly a third off the per-sample cost. Each activation is within 3.3e-7 of
+    // libm; fed back through the recurrence this stays below ecoErrorBound at the output
+    // (measured on sweeps, noise and drive automation from -20 to +10 dBFS, every kernel).
+    // The exception is full-scale low-frequency input at maximum drive, where the model is
+    // sensitive to rounding itself: there the exact kernels on different instruction sets
+    // already differ by up to 0.04, and eco lands within the same spread.
+    static constexpr float ecoErrorBound = 2.0e-4f; // about -74 dBFS
+
+    void setEcoMode(bool shouldUseEco) noexcept { eco = shouldUseEco; }
+    bool isEcoMode() const noexcept { return eco; }
+
+    // Runs the hidden-size matrices from their int8 or fp16 copies (per-row scales, float
+    // state and accumulation), cutting their footprint to a quarter or half. ModelAccuracy::measure()
+    // reports the output error of each precision against Float32.
+    void setPrecision(LSTMWeights::Precision newPrecision) noexcept { precision = newPrecision; }
+    LSTMWeights::Precision getPrecision() const noexcept { return precision; }
+
+    // Sample rate the loaded model was trained at
+    double getModelSampleRate() const noexcept { return weights != nullptr ? weights->sampleRate : LSTMWeights::defaultSampleRate; }
+
+    // Drive changes glide linearly over this many samples, carrying on into the next blocks,
+    // so the glide length does not depend on the block size. A glide still starts with the
+    // block that sees the new drive: output only matches across block sizes when the caller
+    // cuts blocks at its parameter changes, as tools/OfflineRender does. The block is split
+    // where a glide ends: only the gliding part pays for the per-sample drive. 0 (the
+    // default) glides over each block that sees a new drive instead.
+    void setDriveRampSamples(int numSamples) noexcept { driveRampSamples = std::max(0, numSamples); }
+
+    // Writes model(x) + x, or model(x) alone for a model trained without the skip connection.
+    // When an OutputStage prepared for the same channel count is given,
+    // its tone and gain are applied to each sample before it is stored, and its block is closed.
+    // Fewer channels than prepared are fine: lanes left without one run on silence. Channels
+    // past the prepared count are not touched, so prepare() for the most the caller will pass.
+    void process(const float* const* inData, float* const* outData, int numChannels, float driveParam, int numSamples, OutputStage* outputStage = nullptr);
+
     int input_size = 2;
-    
-    float previousDrive = 0.5f;
+
+    float previousDrive = 0.5f; // drive the last processed sample ran at
     float steppedValue = 0.f;
-    bool changedValue = false;
+    bool changedValue = false;  // the last block glided
 
 private:
-    RTNeural::ModelT<float, 2, 1,
-        RTNeural::LSTMLayerT<float, 2, 32>,
-        RTNeural::DenseT<float, 32, 1>> model;
-    
-    float inArray alignas(16)[2] = { 0.0, 0.0 };
+    static constexpr int maxLayers = LSTMWeights::maxLayers;
+
+    struct LaneGroup : LaneLayout::Group
+    {
+        // hiddenSize * numLanes values per layer, lane-interleaved: [j * numLanes + lane].
+        // cell is only used by LSTM models.
+        std::vector<float> hidden[maxLayers];
+        std::vector<float> cell[maxLayers];
+    };
+
+    // Sizes the state and scratch for the loaded architecture
+    void allocateState();
+
+    // Adds the drive column of W_ih to the bias, so a steady drive costs nothing per sample
+    void foldDrive(float drive) noexcept;
+
+    bool isSilent(const float* const* inData, int numChannels, int numSamples) const noexcept;
+    void saveState() noexcept;
+    bool stateSettled() const noexcept;
+    void enterSleep() noexcept;
+
+    const LSTMKernels::Kernel* kernel = &LSTMKernels::best();
+    bool eco = false;
+    LSTMWeights::Precision precision = LSTMWeights::Precision::Float32;
+
+    // Shared, read-only model weights
+    std::shared_ptr<const LSTMWeights> weights;
+
+    // Per-instance drive fold: bias + W_ih[:, 1] * foldedDrive
+    std::vector<float> foldedBias;
+    float foldedDrive = 0.f;
+
+    // Drive glide towards driveTarget, driveRampRemaining samples from its end
+    int driveRampSamples = 0;
+    int driveRampRemaining = 0;
+    float driveTarget = 0.5f;
+
+    // Recurrent state
+    std::vector<LaneGroup> groups;
+    int numPreparedChannels = 0;
+
+    // Idle detection
+    float idleThreshold = 0.0f;
+    int idleHoldSamples = 0;
+    int silentSamples = 0;
+    bool sleeping = false;
+    std::vector<float> savedState; // every state vector of every group, at the start of a candidate block
+    std::vector<float> restOutput; // model output per channel while asleep
 };
@@ -0,0 +1,500 @@
+// Golden-output regression check: renders a fixed set of synthetic signals (plus any
+// recordings given) through PunkDistAudioProcessor under a set of configurations, compares
+// every render with a stored reference and reports max and RMS error, null depth and time.
+//
+//   GoldenCheck --record DIR [--model-json file] [--block n] inputs...
+//   GoldenCheck --check DIR [--model-json file] [--block n] [--format json|csv] [--output file] inputs...
+//
+// --record writes the reference renders to DIR/<config>/<signal>.wav (32-bit float) and their
+// timing to DIR/golden.json; only configurations that are their own reference are stored.
+// --check renders everything again and compares each configuration with the stored render of
+// its reference: exact configurations with themselves, approximate modes (ECO, Float16 and Int8
+// weights) and the model loaded from its training JSON with the exact render of the same
+// settings. It exits with 1 if any comparison is over its error budget or has no reference.
+//
+// Inputs are recordings used as extra signals, taken as audio at each configuration's rate;
+// the same files must be given to --record and --check. Null depth is error power over
+// reference power in dB. Timing is processBlock wall time per sample frame from one pass,
+// shown next to the time recorded with the references.
+
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Largest difference from the reference allowed per sample and in null depth. The exact
+    // budget covers the exact kernels of different instruction sets, which differ by up to
+    // -85 dB at full scale and maximum drive; the others are a few dB above what the built-in
+    // model measures on these signals.
+    struct Budget
+    {
+        const char* name;
+        double maxError;
+        double nullDb;
+    };
+
+    constexpr Budget exact { "exact", 2.0e-3, -80.0 };
+    constexpr Budget eco { "eco", 5.0e-3, -80.0 };
+    constexpr Budget float16 { "float16", 3.0e-2, -50.0 };
+    constexpr Budget int8 { "int8", 0.5, -22.0 };
+
+    struct Event
+    {
+        double time;
+        const char* parameterID;
+        const char* value;
+    };
+
+    struct Config
+    {
+        const char* name;
+        const char* reference; // configuration whose stored render this one is compared with
+        Budget budget;
+        double sampleRate;
+        std::vector<std::pair<const char*, const char*>> parameters; // on top of the defaults
+        std::vector<Event> automation;
+        bool jsonModel = false; // the built-in model, loaded from minidist_model.json instead
+    };
+
+    // The built-in model trains at 44.1 kHz, so only "resampled" converts
+    const std::vector<Config>& getConfigs()
+    {
+        static const std::vector<Config> configs {
+            { "clean", "clean", exact, 44100.0, { { "DRIVE", "0" } } },
+            { "default", "default", exact, 44100.0, {} },
+            { "hot", "hot", exact, 44100.0, { { "DRIVE", "1" }, { "TONE1", "10" }, { "TONE2", "0" }, { "LEVEL", "-6" } } },
+            { "scooped", "scooped", exact, 44100.0, { { "DRIVE", "0.7" }, { "TONE1", "0" }, { "TONE2", "10" }, { "LEVEL", "3" } } },
+            { "automated", "automated", exact, 44100.0, {},
+              { { 0.25, "DRIVE", "0.9" }, { 0.5, "TONE1", "9" }, { 0.8, "DRIVE", "0.2" }, { 1.1, "LEVEL", "-4" }, { 1.4, "TONE2", "1" } } },
+            { "resampled", "resampled", exact, 96000.0, { { "RESAMPLE", "High" } } },
+            { "default-json", "default", exact, 44100.0, {}, {}, true },
+            { "default-eco", "default", eco, 44100.0, { { "ECO", "1" } } },
+            { "hot-eco", "hot", eco, 44100.0, { { "DRIVE", "1" }, { "TONE1", "10" }, { "TONE2", "0" }, { "LEVEL", "-6" }, { "ECO", "1" } } },
+            { "default-float16", "default", float16, 44100.0, { { "WEIGHTS", "Float16" } } },
+            { "hot-float16", "hot", float16, 44100.0, { { "DRIVE", "1" }, { "TONE1", "10" }, { "TONE2", "0" }, { "LEVEL", "-6" }, { "WEIGHTS", "Float16" } } },
+            { "default-int8", "default", int8, 44100.0, { { "WEIGHTS", "Int8" } } },
+            { "hot-int8", "hot", int8, 44100.0, { { "DRIVE", "1" }, { "TONE1", "10" }, { "TONE2", "0" }, { "LEVEL", "-6" }, { "WEIGHTS", "Int8" } } },
+        };
+        return configs;
+    }
+
+    struct Options
+    {
+        juce::File dir;
+        bool record = false;
+        juce::File modelJson { PUNKDIST_MODEL_JSON };
+        int blockSize = 512;
+        std::string format = "json";
+        std::string output;
+    };
+
+    bool parseOptions(const juce::StringArray& args, Options& options, juce::Array<juce::File>& inputs)
+    {
+        bool haveMode = false;
+        for (int i = 0; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            if (!arg.startsWith("--")) {
+                inputs.add(juce::File::getCurrentWorkingDirectory().getChildFile(arg));
+                continue;
+            }
+
+            if (i + 1 >= args.size())
+                return false;
+
+            const auto value = args[++i];
+            if (arg == "--record" || arg == "--check") {
+                if (haveMode)
+                    return false;
+                options.dir = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+                options.record = arg == "--record";
+                haveMode = true;
+            } else if (arg == "--model-json") {
+                options.modelJson = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+            } else if (arg == "--block") {
+                options.blockSize = juce::jlimit(1, 1 << 16, value.getIntValue());
+            } else if (arg == "--format" && (value == "json" || value == "csv")) {
+                options.format = value.toStdString();
+            } else if (arg == "--output") {
+                options.output = value.toStdString();
+            } else {
+                return false;
+            }
+        }
+
+        return haveMode;
+    }
+
+    struct Signal
+    {
+        juce::String name;
+        juce::AudioBuffer<float> audio; // stereo
+    };
+
+    // Two seconds each, the right channel a quieter copy with the polarity flipped so the
+    // lanes differ: log sweeps at three levels, plucked notes, white noise, and bursts with
+    // silence between them for idle detection to sleep through
+    std::vector<Signal> makeSignals(double sampleRate, const juce::Array<juce::File>& inputs, juce::String& error)
+    {
+        const int numSamples = (int) (2.0 * sampleRate);
+        const double twoPi = juce::MathConstants<double>::twoPi;
+        std::vector<Signal> signals;
+
+        auto add = [&](const juce::String& name, auto&& generate) {
+            Signal signal { name, juce::AudioBuffer<float>(2, numSamples) };
+            for (int i = 0; i < numSamples; ++i) {
+                const float x = (float) generate(i);
+                signal.audio.setSample(0, i, x);
+                signal.audio.setSample(1, i, -0.5f * x);
+            }
+            signals.push_back(std::move(signal));
+        };
+
+        const double sweepTop = std::min(20000.0, 0.45 * sampleRate);
+        for (const double level : { -20.0, -6.0, 0.0 }) {
+            const double gain = juce::Decibels::decibelsToGain(level);
+            const double k = std::log(sweepTop / 20.0);
+            add("sweep" + juce::String((int) level), [&](int i) {
+                const double t = i / sampleRate;
+                return gain * std::sin(twoPi * 20.0 * 2.0 / k * (std::exp(k * t / 2.0) - 1.0));
+            });
+        }
+
+        const double notes[] = { 82.41, 110.0, 146.83, 196.0 };
+        const int noteLength = (int) (0.5 * sampleRate);
+        add("plucks", [&](int i) {
+            const double t = (i % noteLength) / sampleRate;
+            double pluck = 0.0;
+            for (int harmonic = 1; harmonic <= 4; ++harmonic)
+                pluck += std::sin(twoPi * notes[(i / noteLength) % 4] * harmonic * t) / harmonic;
+            return 0.4 * pluck * std::exp(-3.0 * t);
+        });
+
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<double> noise(-0.5, 0.5);
+        add("noise", [&](int) { return noise(random); });
+
+        const int burstPeriod = (int) (0.4 * sampleRate), burstLength = (int) (0.1 * sampleRate);
+        add("bursts", [&](int i) { return i % burstPeriod < burstLength ? 0.5 * std::sin(twoPi * 220.0 * i / sampleRate) : 0.0; });
+
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+        for (const auto& input : inputs) {
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(input));
+            if (reader == nullptr || reader->lengthInSamples > std::numeric_limits<int>::max()) {
+                error = "cannot read " + input.getFullPathName();
+                return {};
+            }
+
+            // Mono is played on both channels; channels beyond the second are dropped
+            Signal signal { input.getFileNameWithoutExtension(), juce::AudioBuffer<float>(2, (int) reader->lengthInSamples) };
+            reader->read(&signal.audio, 0, signal.audio.getNumSamples(), 0, true, true);
+            signals.push_back(std::move(signal));
+        }
+
+        return signals;
+    }
+
+    bool setParameter(PunkDistAudioProcessor& processor, const juce::String& parameterID, const juce::String& text)
+    {
+        auto* parameter = processor.state.getParameter(parameterID);
+        if (parameter == nullptr)
+            return false;
+
+        // Plain numbers are in the parameter's units; anything else is a choice or bool name
+        const bool numeric = text.containsOnly("+-.0123456789eE");
+        parameter->setValueNotifyingHost(numeric ? parameter->convertTo0to1(text.getFloatValue()) : parameter->getValueForText(text));
+        return true;
+    }
+
+    // A fresh processor for every render, so nothing carries over from the one before. Runs
+    // in real-time mode, where ECO and WEIGHTS take effect. Returns processBlock time per frame.
+    double render(const Config& config, const Signal& signal, const Options& options, juce::AudioBuffer<float>& output, juce::String& error)
+    {
+        PunkDistAudioProcessor processor;
+        if (config.jsonModel) {
+            processor.loadModel(options.modelJson);
+            while (processor.isModelLoading())
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            if (processor.getModelError().isNotEmpty()) {
+                error = processor.getModelError();
+                return 0.0;
+            }
+        }
+
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(juce::AudioChannelSet::stereo());
+        layout.outputBuses.add(juce::AudioChannelSet::stereo());
+        processor.setBusesLayout(layout);
+
+        for (const auto& [parameterID, value] : config.parameters) {
+            if (!setParameter(processor, parameterID, value)) {
+                error = juce::String("unknown parameter ") + parameterID;
+                return 0.0;
+            }
+        }
+
+        processor.setRateAndBufferSizeDetails(config.sampleRate, options.blockSize);
+        processor.prepareToPlay(config.sampleRate, options.blockSize);
+
+        const int numSamples = signal.audio.getNumSamples();
+        output.makeCopyOf(signal.audio);
+        juce::MidiBuffer midi;
+        size_t nextEvent = 0;
+        double nanos = 0.0;
+
+        // Automation lands at its sample: the block is cut short in front of it
+        for (int start = 0; start < numSamples;) {
+            int blockLength = std::min(options.blockSize, numSamples - start);
+            for (; nextEvent < config.automation.size(); ++nextEvent) {
+                const auto& event = config.automation[nextEvent];
+                const int position = (int) std::llround(event.time * config.sampleRate);
+                if (position > start) {
+                    blockLength = std::min(blockLength, position - start);
+                    break;
+                }
+                setParameter(processor, event.parameterID, event.value);
+            }
+
+            juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), 2, start, blockLength);
+            const auto begin = std::chrono::steady_clock::now();
+            processor.processBlock(block, midi);
+            nanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+            start += blockLength;
+        }
+
+        processor.releaseResources();
+        return nanos / numSamples;
+    }
+
+    juce::File getReferenceFile(const Options& options, const char* config, const juce::String& signal)
+    {
+        return options.dir.getChildFile(config).getChildFile(signal + ".wav");
+    }
+
+    bool writeWav(const juce::File& file, const juce::AudioBuffer<float>& audio, double sampleRate)
+    {
+        if (!file.getParentDirectory().createDirectory() || (file.exists() && !file.deleteFile()))
+            return false;
+
+        juce::WavAudioFormat format;
+        auto stream = file.createOutputStream();
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream != nullptr)
+            writer.reset(format.createWriterFor(stream.get(), sampleRate, (unsigned int) audio.getNumChannels(), 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+        stream.release(); // owned by the writer now
+
+        return writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+    }
+
+    bool readWav(const juce::File& file, juce::AudioBuffer<float>& audio)
+    {
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        if (auto stream = file.createInputStream())
+            reader.reset(format.createReaderFor(stream.release(), true));
+        if (reader == nullptr || reader->lengthInSamples > std::numeric_limits<int>::max())
+            return false;
+
+        audio.setSize((int) reader->numChannels, (int) reader->lengthInSamples);
+        return reader->read(&audio, 0, audio.getNumSamples(), 0, true, true);
+    }
+
+    struct Result
+    {
+        std::string config, signal, reference, budget;
+        double maxError = 0.0, rmsError = 0.0, nullDb = 0.0;
+        double nsPerSample = 0.0, recordedNsPerSample = 0.0; // 0: nothing recorded
+        bool pass = false;
+        std::string error;
+    };
+
+    // Over every sample of every channel. An exact match is reported as -200 dB.
+    void compare(const juce::AudioBuffer<float>& output, const juce::AudioBuffer<float>& reference, Result& result)
+    {
+        double errorPower = 0.0, referencePower = 0.0;
+        for (int ch = 0; ch < output.getNumChannels(); ++ch) {
+            const float* out = output.getReadPointer(ch);
+            const float* ref = reference.getReadPointer(ch);
+            for (int i = 0; i < output.getNumSamples(); ++i) {
+                const double difference = (double) out[i] - ref[i];
+                result.maxError = std::max(result.maxError, std::abs(difference));
+                errorPower += difference * difference;
+                referencePower += (double) ref[i] * ref[i];
+            }
+        }
+
+        const double numValues = (double) output.getNumChannels() * output.getNumSamples();
+        result.rmsError = std::sqrt(errorPower / numValues);
+        result.nullDb = errorPower == 0.0 ? -200.0 : referencePower == 0.0 ? 0.0 : 10.0 * std::log10(errorPower / referencePower);
+    }
+
+    std::string toJson(const std::vector<Result>& results, const Options& options)
+    {
+        nlohmann::json json;
+        json["version"] = VERSION;
+        json["build_type"] = CMAKE_BUILD_TYPE;
+        json["kernel"] = LSTMKernels::best().name;
+        json["block_size"] = options.blockSize;
+
+        json["results"] = nlohmann::json::array();
+        for (const auto& r : results) {
+            json["results"].push_back({ { "config", r.config },
+                                        { "signal", r.signal },
+                                        { "reference", r.reference },
+                                        { "budget", r.budget },
+                                        { "max_error", r.maxError },
+                                        { "rms_error", r.rmsError },
+                                        { "null_db", r.nullDb },
+                                        { "ns_per_sample", r.nsPerSample },
+                                        { "recorded_ns_per_sample", r.recordedNsPerSample },
+                                        { "pass", r.pass },
+                                        { "error", r.error } });
+        }
+        return json.dump(2) + "\n";
+    }
+
+    std::string toCsv(const std::vector<Result>& results)
+    {
+        std::string csv = "config,signal,reference,budget,max_error,rms_error,null_db,ns_per_sample,recorded_ns_per_sample,pass\n";
+        char line[512];
+        for (const auto& r : results) {
+            std::snprintf(line, sizeof(line), "%s,%s,%s,%s,%.3e,%.3e,%.1f,%.3f,%.3f,%d\n", r.config.c_str(), r.signal.c_str(), r.reference.c_str(),
+                          r.budget.c_str(), r.maxError, r.rmsError, r.nullDb, r.nsPerSample, r.recordedNsPerSample, r.pass ? 1 : 0);
+            csv += line;
+        }
+        return csv;
+    }
+
+    // Timing stored with the references, by config and signal
+    std::map<std::string, double> readRecordedTiming(const Options& options)
+    {
+        std::map<std::string, double> timing;
+        std::ifstream file(options.dir.getChildFile("golden.json").getFullPathName().toStdString());
+        if (!file)
+            return timing;
+
+        try {
+            for (const auto& entry : nlohmann::json::parse(file).at("renders"))
+                timing[entry.at("config").get<std::string>() + "/" + entry.at("signal").get<std::string>()] = entry.at("ns_per_sample").get<double>();
+        } catch (const std::exception&) {
+            timing.clear();
+        }
+        return timing;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    juce::Array<juce::File> inputs;
+    if (!parseOptions(juce::StringArray(argv + 1, argc - 1), options, inputs)) {
+        std::fprintf(stderr, "usage: GoldenCheck --record DIR [--model-json file] [--block n] inputs...\n"
+                             "       GoldenCheck --check DIR [--model-json file] [--block n] [--format json|csv] [--output file] inputs...\n");
+        return 1;
+    }
+
+    // The processor's parameters and async updates expect a message manager to exist
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const auto recordedTiming = options.record ? std::map<std::string, double>() : readRecordedTiming(options);
+    nlohmann::json manifest;
+    manifest["version"] = VERSION;
+    manifest["kernel"] = LSTMKernels::best().name;
+    manifest["block_size"] = options.blockSize;
+    manifest["renders"] = nlohmann::json::array();
+
+    std::vector<Result> results;
+    bool ok = true;
+    for (const auto& config : getConfigs()) {
+        // Only references are stored, but every configuration is timed
+        const bool isReference = std::string(config.name) == config.reference;
+
+        juce::String error;
+        const auto signals = makeSignals(config.sampleRate, inputs, error);
+        if (signals.empty()) {
+            std::fprintf(stderr, "GoldenCheck: %s\n", error.toRawUTF8());
+            return 1;
+        }
+
+        for (const auto& signal : signals) {
+            Result result;
+            result.config = config.name;
+            result.signal = signal.name.toStdString();
+            result.reference = config.reference;
+            result.budget = config.budget.name;
+
+            juce::AudioBuffer<float> output;
+            result.nsPerSample = render(config, signal, options, output, error);
+
+            if (error.isEmpty() && options.record) {
+                if (isReference && !writeWav(getReferenceFile(options, config.name, signal.name), output, config.sampleRate))
+                    error = "cannot write " + getReferenceFile(options, config.name, signal.name).getFullPathName();
+                manifest["renders"].push_back({ { "config", result.config }, { "signal", result.signal }, { "ns_per_sample", result.nsPerSample } });
+                std::fprintf(stderr, "%-16s %-10s %8.2f ns/sample%s\n", config.name, signal.name.toRawUTF8(), result.nsPerSample, isReference ? ", stored" : "");
+            } else if (error.isEmpty()) {
+                juce::AudioBuffer<float> reference;
+                const auto file = getReferenceFile(options, config.reference, signal.name);
+                if (!readWav(file, reference))
+                    error = "no reference " + file.getFullPathName();
+                else if (reference.getNumChannels() != output.getNumChannels() || reference.getNumSamples() != output.getNumSamples())
+                    error = "reference " + file.getFullPathName() + " has another length or channel count";
+                else
+                    compare(output, reference, result);
+
+                const auto recorded = recordedTiming.find(result.config + "/" + result.signal);
+                result.recordedNsPerSample = recorded != recordedTiming.end() ? recorded->second : 0.0;
+                result.pass = error.isEmpty() && result.maxError <= config.budget.maxError && result.nullDb <= config.budget.nullDb;
+
+                std::fprintf(stderr, "%-16s %-10s max %.2e rms %.2e null %7.1f dB %8.2f ns/sample (recorded %.2f)  %s\n", config.name,
+                             signal.name.toRawUTF8(), result.maxError, result.rmsError, result.nullDb, result.nsPerSample, result.recordedNsPerSample,
+                             result.pass ? "ok" : "OVER BUDGET");
+            }
+
+            if (error.isNotEmpty()) {
+                std::fprintf(stderr, "GoldenCheck: %s %s: %s\n", config.name, signal.name.toRawUTF8(), error.toRawUTF8());
+                result.error = error.toStdString();
+                error.clear();
+            }
+
+            ok = ok && (options.record ? result.error.empty() : result.pass);
+            results.push_back(std::move(result));
+        }
+    }
+
+    if (options.record) {
+        std::ofstream file(options.dir.getChildFile("golden.json").getFullPathName().toStdString());
+        file << manifest.dump(2) << "\n";
+        if (!file) {
+            std::fprintf(stderr, "GoldenCheck: cannot write %s\n", options.dir.getChildFile("golden.json").getFullPathName().toRawUTF8());
+            return 1;
+        }
+        return ok ? 0 : 1;
+    }
+
+    const std::string text = options.format == "csv" ? toCsv(results) : toJson(results, options);
+    if (options.output.empty()) {
+        std::cout << text;
+    } else {
+        std::ofstream file(options.output);
+        file << text;
+        if (!file) {
+            std::fprintf(stderr, "GoldenCheck: cannot write %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+// Build-time tool: packs a training JSON into the binary model blob embedded in the plugin.
+// Usage: ModelConverter <model.json> <model.bin> [--report]
+// With --report it also prints how far the int8 and fp16 weight paths (and eco mode)
+// land from exact Float32 inference of the packed model.
+
+#include "ModelAccuracy.h"
+#include "ModelBlobJson.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static void printReport(const std::vector<char>& blob)
+{
+    using Precision = LSTMWeights::Precision;
+    const struct
+    {
+        const char* name;
+        Precision precision;
+        bool eco;
+    } paths[] = { { "fp16", Precision::Float16, false }, { "int8", Precision::Int8, false }, { "eco", Precision::Float32, true } };
+
+    for (const auto& path : paths) {
+        const auto report = ModelAccuracy::measure(blob.data(), blob.size(), path.precision, path.eco);
+        std::printf("ModelConverter: %-4s vs fp32: max error %.3g (%.1f dBFS), rms %.3g, SNR %.1f dB over %d samples\n",
+                    path.name, report.maxAbsError, 20.0 * std::log10(std::max(report.maxAbsError, 1.0e-12)), report.rmsError, report.snrDb, report.numSamples);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const bool report = argc == 4 && std::strcmp(argv[3], "--report") == 0;
+    if (argc != 3 && !report) {
+        std::cerr << "Usage: ModelConverter <model.json> <model.bin> [--report]" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::ifstream jsonStream(argv[1]);
+        const auto blob = ModelBlob::fromJson(nlohmann::json::parse(jsonStream));
+
+        std::ofstream blobStream(argv[2], std::ios::binary);
+        blobStream.write(blob.data(), (std::streamsize) blob.size());
+        if (!blobStream) {
+            std::cerr << "ModelConverter: could not write " << argv[2] << std::endl;
+            return 1;
+        }
+
+        if (report)
+            printReport(blob);
+    } catch (const std::exception& e) {
+        std::cerr << "ModelConverter: " << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
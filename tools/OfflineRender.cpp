@@ -0,0 +1,650 @@
+// Headless batch renderer: streams WAV/AIFF files through PunkDistAudioProcessor, many
+// files at once. Every worker thread owns one processor; files are dealt out largest first
+// and a worker that runs dry steals from the back of another worker's queue.
+//
+//   OfflineRender --out-dir DIR [--param ID=value ...] [--automation file.csv]
+//                 [--model file] [--block n] [--bits 16|24|32] [--jobs n]
+//                 [--chunked maxError [--verify]] inputs...
+//
+// Inputs are files or directories (searched recursively for .wav/.aif/.aiff); the renders
+// keep their names and, under a directory input, their relative paths. Parameter values are
+// in the parameter's own units (DRIVE=0.7, LEVEL=-3) or choice names (RESAMPLE=High).
+// The automation file holds "seconds,PARAM_ID,value" lines, applied at the exact sample;
+// parameter glides are fixed in time, so the render does not depend on --block.
+//
+// --chunked also splits long files so one file keeps every core busy. Each chunk starts
+// getPreRollSamples(maxError) early on a fresh processor and drops that lead-in, so the
+// stitched render stays within maxError of a sequential one. --verify renders each chunked
+// file sequentially as well and prints the largest difference.
+
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct AutomationEvent
+    {
+        double time;
+        juce::String parameterID;
+        juce::String value;
+    };
+
+    struct Options
+    {
+        juce::File outDir;
+        std::vector<std::pair<juce::String, juce::String>> parameters;
+        std::vector<AutomationEvent> automation;
+        juce::File model;
+        int blockSize = 512;
+        int bits = 0; // 0: same as the input
+        int numJobs = (int) std::max(1u, std::thread::hardware_concurrency());
+        float chunkError = 0.0f; // 0: files are rendered in one piece
+        bool verify = false;
+    };
+
+    struct Job
+    {
+        juce::File input, output;
+        juce::int64 size;
+
+        // Chunks: the part of the input this job writes, rendered after preRoll samples of
+        // lead-in. A length of -1 is the rest of the file.
+        juce::int64 start = 0, length = -1;
+        int preRoll = 0;
+        int bits = 0; // 0: --bits, or else the input's
+    };
+
+    // A file split into chunks, stitched together once they are all rendered
+    struct ChunkedFile
+    {
+        Job whole;
+        std::vector<size_t> chunks;
+        size_t sequential = 0; // --verify: the same file rendered in one piece
+    };
+
+    // Shortest chunk worth its lead-in, in samples of pre-roll and in seconds
+    constexpr int minChunkPreRolls = 20;
+    constexpr double minChunkSeconds = 10.0;
+
+    // Disk reads and writes go through buffers of this many samples, processed in blocks
+    constexpr int chunkSamples = 1 << 16;
+
+    std::mutex printMutex;
+
+    template <typename... Args>
+    void print(FILE* stream, const char* format, Args... args)
+    {
+        const std::lock_guard<std::mutex> lock(printMutex);
+        std::fprintf(stream, format, args...);
+    }
+
+    bool parseAutomation(const juce::File& file, std::vector<AutomationEvent>& events)
+    {
+        if (!file.existsAsFile())
+            return false;
+
+        for (const auto& line : juce::StringArray::fromLines(file.loadFileAsString())) {
+            const auto trimmed = line.trim();
+            if (trimmed.isEmpty() || trimmed.startsWithChar('#'))
+                continue;
+
+            const auto fields = juce::StringArray::fromTokens(trimmed, ",", "\"");
+            if (fields.size() != 3)
+                return false;
+
+            events.push_back({ fields[0].trim().getDoubleValue(), fields[1].trim(), fields[2].trim() });
+        }
+
+        std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+        return true;
+    }
+
+    bool parseOptions(const juce::StringArray& args, Options& options, juce::Array<juce::File>& inputs)
+    {
+        for (int i = 0; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            if (!arg.startsWith("--")) {
+                inputs.add(juce::File::getCurrentWorkingDirectory().getChildFile(arg));
+                continue;
+            }
+
+            if (arg == "--verify") {
+                options.verify = true;
+                continue;
+            }
+
+            if (i + 1 >= args.size())
+                return false;
+
+            const auto value = args[++i];
+            if (arg == "--out-dir") {
+                options.outDir = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+            } else if (arg == "--param" && value.containsChar('=')) {
+                options.parameters.emplace_back(value.upToFirstOccurrenceOf("=", false, false), value.fromFirstOccurrenceOf("=", false, false));
+            } else if (arg == "--automation") {
+                if (!parseAutomation(juce::File::getCurrentWorkingDirectory().getChildFile(value), options.automation))
+                    return false;
+            } else if (arg == "--model") {
+                options.model = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+            } else if (arg == "--block") {
+                options.blockSize = juce::jlimit(1, chunkSamples, value.getIntValue());
+            } else if (arg == "--bits") {
+                options.bits = value.getIntValue();
+            } else if (arg == "--jobs") {
+                options.numJobs = std::max(1, value.getIntValue());
+            } else if (arg == "--chunked") {
+                options.chunkError = value.getFloatValue();
+                if (options.chunkError <= 0.0f)
+                    return false;
+            } else {
+                return false;
+            }
+        }
+
+        return options.outDir != juce::File() && !inputs.isEmpty() && (!options.verify || options.chunkError > 0.0f);
+    }
+
+    std::vector<Job> collectJobs(const juce::Array<juce::File>& inputs, const juce::File& outDir)
+    {
+        std::vector<Job> jobs;
+        for (const auto& input : inputs) {
+            if (input.isDirectory()) {
+                for (const auto& entry : juce::RangedDirectoryIterator(input, true, "*.wav;*.aif;*.aiff", juce::File::findFiles))
+                    jobs.push_back({ entry.getFile(), outDir.getChildFile(entry.getFile().getRelativePathFrom(input)), entry.getFileSize() });
+            } else {
+                jobs.push_back({ input, outDir.getChildFile(input.getFileName()), input.getSize() });
+            }
+        }
+
+        // Longest first, so the last files to finish are short ones
+        std::stable_sort(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) { return a.size > b.size; });
+        return jobs;
+    }
+
+    bool setParameter(PunkDistAudioProcessor& processor, const juce::String& parameterID, const juce::String& text)
+    {
+        auto* parameter = processor.state.getParameter(parameterID);
+        if (parameter == nullptr)
+            return false;
+
+        // Plain numbers are in the parameter's units; anything else is a choice or bool name
+        const bool numeric = text.containsOnly("+-.0123456789eE");
+        parameter->setValueNotifyingHost(numeric ? parameter->convertTo0to1(text.getFloatValue()) : parameter->getValueForText(text));
+        return true;
+    }
+
+    // One processor per worker, reused from file to file
+    class Renderer
+    {
+    public:
+        explicit Renderer(const Options& optionsToUse) : options(optionsToUse)
+        {
+            formats.registerBasicFormats();
+
+            // Offline: the processor keeps full-precision weights and exact activations
+            processor.setNonRealtime(true);
+
+            if (options.model != juce::File())
+                processor.loadModel(options.model);
+        }
+
+        bool hasParameter(const juce::String& parameterID) { return processor.state.getParameter(parameterID) != nullptr; }
+
+        // Message thread: waits for the --model file to be loaded in the background
+        juce::String waitForModel()
+        {
+            while (processor.isModelLoading())
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            return processor.getModelError();
+        }
+
+        // Same parameters and a fresh processor state for every file and chunk
+        bool prepare(int numChannels, double sampleRate, juce::int64 firstSample, size_t& nextEvent, juce::String& error)
+        {
+            juce::AudioProcessor::BusesLayout layout;
+            layout.inputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+            layout.outputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+            if (!processor.setBusesLayout(layout)) {
+                error = "unsupported channel count " + juce::String(numChannels);
+                return false;
+            }
+
+            for (auto* parameter : processor.getParameters())
+                parameter->setValueNotifyingHost(parameter->getDefaultValue());
+            for (const auto& [parameterID, value] : options.parameters)
+                setParameter(processor, parameterID, value);
+
+            // Automation before the first rendered sample sets where the render starts from
+            nextEvent = 0;
+            for (; nextEvent < options.automation.size(); ++nextEvent) {
+                const auto& event = options.automation[nextEvent];
+                if (std::llround(event.time * sampleRate) > firstSample)
+                    break;
+                setParameter(processor, event.parameterID, event.value);
+            }
+
+            processor.setRateAndBufferSizeDetails(sampleRate, options.blockSize);
+            processor.prepareToPlay(sampleRate, options.blockSize);
+            return true;
+        }
+
+        // Lead-in a chunk needs to land within maxError of a sequential render
+        int getPreRoll(int numChannels, double sampleRate, float maxError)
+        {
+            size_t nextEvent;
+            juce::String error;
+            if (!prepare(numChannels, sampleRate, 0, nextEvent, error))
+                return -1;
+
+            const int preRoll = processor.getPreRollSamples(maxError);
+            processor.releaseResources();
+            return preRoll;
+        }
+
+        bool render(const Job& job, juce::String& error)
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(job.input));
+            if (reader == nullptr) {
+                error = "cannot read " + job.input.getFullPathName();
+                return false;
+            }
+
+            const int numChannels = (int) reader->numChannels;
+            const double sampleRate = reader->sampleRate;
+            const juce::int64 fileLength = reader->lengthInSamples;
+
+            auto* format = formats.findFormatForFileExtension(job.output.getFileExtension());
+            const int bits = job.bits > 0 ? job.bits : options.bits > 0 ? options.bits : (int) reader->bitsPerSample;
+            if (!job.output.getParentDirectory().createDirectory() || (job.output.exists() && !job.output.deleteFile())) {
+                error = "cannot create " + job.output.getFullPathName();
+                return false;
+            }
+
+            auto stream = job.output.createOutputStream();
+            std::unique_ptr<juce::AudioFormatWriter> writer;
+            if (format != nullptr && stream != nullptr)
+                writer.reset(format->createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels, bits, {}, 0));
+            if (writer == nullptr) {
+                error = "cannot write " + juce::String(bits) + "-bit " + job.output.getFullPathName();
+                return false;
+            }
+            stream.release(); // owned by the writer now
+
+            // Input from firstSample on goes through the processor; the lead-in and the
+            // resampling delay are cut from the start, and the delay is made up at the end
+            const juce::int64 firstSample = job.start - job.preRoll;
+            size_t nextEvent;
+            if (!prepare(numChannels, sampleRate, firstSample, nextEvent, error))
+                return false;
+
+            const int latency = processor.getLatencySamples();
+            const juce::int64 outputLength = job.length < 0 ? fileLength - job.start : job.length;
+            const juce::int64 totalLength = job.preRoll + outputLength + latency;
+            juce::int64 toSkip = job.preRoll + latency;
+
+            juce::AudioBuffer<float> buffer(numChannels, chunkSamples);
+            juce::MidiBuffer midi;
+
+            for (juce::int64 position = 0; position < totalLength; position += chunkSamples) {
+                const int chunkLength = (int) std::min<juce::int64>(chunkSamples, totalLength - position);
+                const juce::int64 readPosition = firstSample + position;
+                buffer.clear();
+                if (readPosition < fileLength)
+                    reader->read(&buffer, 0, (int) std::min<juce::int64>(chunkLength, fileLength - readPosition), readPosition, true, true);
+
+                for (int start = 0; start < chunkLength;) {
+                    // Automation lands at its sample: the block is cut short in front of it
+                    int blockLength = std::min(options.blockSize, chunkLength - start);
+                    while (nextEvent < options.automation.size()) {
+                        const auto& event = options.automation[nextEvent];
+                        const auto eventSample = (juce::int64) std::llround(event.time * sampleRate);
+                        if (eventSample > readPosition + start) {
+                            blockLength = (int) std::min<juce::int64>(blockLength, eventSample - readPosition - start);
+                            break;
+                        }
+                        setParameter(processor, event.parameterID, event.value);
+                        ++nextEvent;
+                    }
+
+                    juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), numChannels, start, blockLength);
+                    processor.processBlock(block, midi);
+                    start += blockLength;
+                }
+
+                const int skip = (int) std::min<juce::int64>(toSkip, chunkLength);
+                toSkip -= skip;
+                if (chunkLength > skip && !writer->writeFromAudioSampleBuffer(buffer, skip, chunkLength - skip)) {
+                    error = "write failed for " + job.output.getFullPathName();
+                    return false;
+                }
+            }
+
+            processor.releaseResources();
+            return true;
+        }
+
+    private:
+        const Options& options;
+        juce::AudioFormatManager formats;
+        PunkDistAudioProcessor processor;
+    };
+
+    // Per-worker deques: owners pop from the front, thieves take from the back
+    class WorkStealingQueues
+    {
+    public:
+        WorkStealingQueues(size_t numJobs, int numWorkers) : queues((size_t) numWorkers)
+        {
+            for (size_t job = 0; job < numJobs; ++job)
+                queues[job % queues.size()].jobs.push_back(job);
+        }
+
+        bool next(int worker, size_t& job)
+        {
+            if (queues[(size_t) worker].pop(job, true))
+                return true;
+
+            for (size_t offset = 1; offset < queues.size(); ++offset)
+                if (queues[(worker + offset) % queues.size()].pop(job, false))
+                    return true;
+
+            return false;
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> jobs;
+
+            bool pop(size_t& job, bool front)
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                if (jobs.empty())
+                    return false;
+
+                job = front ? jobs.front() : jobs.back();
+                front ? jobs.pop_front() : jobs.pop_back();
+                return true;
+            }
+        };
+
+        std::vector<Queue> queues;
+    };
+
+    // Temporary float render of part of a file, next to where the file goes
+    juce::File partFile(const juce::File& output, const juce::String& part)
+    {
+        return output.getSiblingFile("." + output.getFileNameWithoutExtension() + "." + part + ".wav");
+    }
+
+    // Splits every long enough file into chunks for the worker pool. Files that cannot
+    // reach maxError from any pre-roll are rendered in one piece.
+    std::vector<Job> planChunks(const std::vector<Job>& files, const Options& options, Renderer& renderer, std::vector<ChunkedFile>& chunked)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+        std::map<std::pair<double, int>, int> preRolls;
+
+        std::vector<Job> jobs;
+        for (const auto& file : files) {
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file.input));
+            if (reader == nullptr) {
+                jobs.push_back(file); // render() reports the error
+                continue;
+            }
+
+            const double sampleRate = reader->sampleRate;
+            const int numChannels = (int) reader->numChannels;
+            const juce::int64 length = reader->lengthInSamples;
+
+            const auto key = std::make_pair(sampleRate, numChannels);
+            if (preRolls.count(key) == 0) {
+                preRolls[key] = renderer.getPreRoll(numChannels, sampleRate, options.chunkError);
+                if (preRolls[key] < 0)
+                    print(stderr, "OfflineRender: no pre-roll reaches %g at %g Hz, %d channels; rendering those files in one piece\n",
+                          (double) options.chunkError, sampleRate, numChannels);
+            }
+
+            const int preRoll = preRolls[key];
+            const auto chunkLength = std::max({ (length + options.numJobs * 2 - 1) / (options.numJobs * 2),
+                                                (juce::int64) preRoll * minChunkPreRolls,
+                                                (juce::int64) (minChunkSeconds * sampleRate) });
+            if (preRoll < 0 || chunkLength >= length) {
+                jobs.push_back(file);
+                continue;
+            }
+
+            ChunkedFile entry;
+            entry.whole = file;
+            for (juce::int64 start = 0; start < length; start += chunkLength) {
+                Job chunk { file.input, partFile(file.output, "part" + juce::String((int) entry.chunks.size())), 0 };
+                chunk.start = start;
+                chunk.length = std::min(chunkLength, length - start);
+                chunk.size = file.size * chunk.length / length;
+                chunk.preRoll = (int) std::min<juce::int64>(preRoll, start);
+                chunk.bits = 32;
+                entry.chunks.push_back(jobs.size());
+                jobs.push_back(chunk);
+            }
+
+            if (options.verify) {
+                Job sequential { file.input, partFile(file.output, "whole"), file.size };
+                sequential.bits = 32;
+                entry.sequential = jobs.size();
+                jobs.push_back(sequential);
+            }
+
+            chunked.push_back(std::move(entry));
+        }
+
+        return jobs;
+    }
+
+    // Joins the rendered chunks into the output file and deletes them. With --verify, reports
+    // the largest difference from the sequential render.
+    bool stitch(const ChunkedFile& file, const std::vector<Job>& jobs, const Options& options, juce::String& error)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> input(formats.createReaderFor(file.whole.input));
+        auto* format = formats.findFormatForFileExtension(file.whole.output.getFileExtension());
+        if (input == nullptr || format == nullptr) {
+            error = "cannot write " + file.whole.output.getFullPathName();
+            return false;
+        }
+
+        const int numChannels = (int) input->numChannels;
+        const int bits = options.bits > 0 ? options.bits : (int) input->bitsPerSample;
+        if (file.whole.output.exists() && !file.whole.output.deleteFile()) {
+            error = "cannot create " + file.whole.output.getFullPathName();
+            return false;
+        }
+
+        auto stream = file.whole.output.createOutputStream();
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream != nullptr)
+            writer.reset(format->createWriterFor(stream.get(), input->sampleRate, (unsigned int) numChannels, bits, {}, 0));
+        if (writer == nullptr) {
+            error = "cannot write " + juce::String(bits) + "-bit " + file.whole.output.getFullPathName();
+            return false;
+        }
+        stream.release(); // owned by the writer now
+
+        std::unique_ptr<juce::AudioFormatReader> sequential;
+        if (options.verify)
+            sequential.reset(formats.createReaderFor(jobs[file.sequential].output));
+
+        juce::AudioBuffer<float> buffer(numChannels, chunkSamples), reference(numChannels, chunkSamples);
+        juce::int64 position = 0;
+        float maxDifference = 0.0f;
+        bool ok = true;
+
+        for (size_t chunk : file.chunks) {
+            std::unique_ptr<juce::AudioFormatReader> part(formats.createReaderFor(jobs[chunk].output));
+            if (part == nullptr) {
+                error = "cannot read " + jobs[chunk].output.getFullPathName();
+                ok = false;
+                break;
+            }
+
+            for (juce::int64 offset = 0; offset < part->lengthInSamples; offset += chunkSamples) {
+                const int length = (int) std::min<juce::int64>(chunkSamples, part->lengthInSamples - offset);
+                part->read(&buffer, 0, length, offset, true, true);
+                if (!writer->writeFromAudioSampleBuffer(buffer, 0, length)) {
+                    error = "write failed for " + file.whole.output.getFullPathName();
+                    ok = false;
+                    break;
+                }
+
+                if (sequential != nullptr) {
+                    sequential->read(&reference, 0, length, position + offset, true, true);
+                    for (int ch = 0; ch < numChannels; ++ch)
+                        for (int i = 0; i < length; ++i)
+                            maxDifference = std::max(maxDifference, std::abs(buffer.getSample(ch, i) - reference.getSample(ch, i)));
+                }
+            }
+
+            position += part->lengthInSamples;
+            part.reset();
+            jobs[chunk].output.deleteFile();
+            if (!ok)
+                break;
+        }
+
+        if (options.verify) {
+            sequential.reset();
+            jobs[file.sequential].output.deleteFile();
+            if (ok)
+                print(stderr, "OfflineRender: %s: %d chunks, max difference from sequential %.3g (%s %g)\n",
+                      file.whole.output.getFileName().toRawUTF8(), (int) file.chunks.size(), (double) maxDifference,
+                      maxDifference <= options.chunkError ? "within" : "EXCEEDS", (double) options.chunkError);
+        }
+
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    juce::Array<juce::File> inputs;
+    if (!parseOptions(juce::StringArray(argv + 1, argc - 1), options, inputs)) {
+        std::fprintf(stderr, "usage: OfflineRender --out-dir DIR [--param ID=value ...] [--automation file.csv]\n"
+                             "                     [--model file] [--block n] [--bits 16|24|32] [--jobs n]\n"
+                             "                     [--chunked maxError [--verify]] inputs...\n");
+        return 1;
+    }
+
+    // The processors' parameters and async updates expect a message manager to exist
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // Processors are created here, on the message thread. The first one also works out the
+    // chunks, which decide how many more are needed.
+    std::vector<std::unique_ptr<Renderer>> renderers;
+    renderers.push_back(std::make_unique<Renderer>(options));
+
+    // Typos in parameter IDs fail up front rather than after hours of rendering
+    juce::StringArray parameterIDs;
+    for (const auto& parameter : options.parameters)
+        parameterIDs.add(parameter.first);
+    for (const auto& event : options.automation)
+        parameterIDs.add(event.parameterID);
+    for (const auto& parameterID : parameterIDs) {
+        if (!renderers.front()->hasParameter(parameterID)) {
+            std::fprintf(stderr, "OfflineRender: unknown parameter %s\n", parameterID.toRawUTF8());
+            return 1;
+        }
+    }
+
+    const auto files = collectJobs(inputs, options.outDir);
+    std::vector<ChunkedFile> chunked;
+    std::vector<Job> jobs = files;
+    if (options.chunkError > 0.0f) {
+        const auto error = renderers.front()->waitForModel();
+        if (error.isEmpty())
+            jobs = planChunks(files, options, *renderers.front(), chunked);
+    }
+
+    // Chunks are only reported once stitched
+    std::vector<bool> isPart(jobs.size(), false);
+    for (const auto& file : chunked) {
+        for (size_t chunk : file.chunks)
+            isPart[chunk] = true;
+        if (options.verify)
+            isPart[file.sequential] = true;
+    }
+
+    const int numWorkers = (int) std::min<size_t>((size_t) options.numJobs, std::max<size_t>(1, jobs.size()));
+    while ((int) renderers.size() < numWorkers)
+        renderers.push_back(std::make_unique<Renderer>(options));
+
+    for (auto& renderer : renderers) {
+        const auto error = renderer->waitForModel();
+        if (error.isNotEmpty()) {
+            std::fprintf(stderr, "OfflineRender: cannot load %s: %s\n", options.model.getFullPathName().toRawUTF8(), error.toRawUTF8());
+            return 1;
+        }
+    }
+
+    WorkStealingQueues queues(jobs.size(), numWorkers);
+    std::vector<char> rendered(jobs.size(), 0);
+    std::atomic<int> failures { 0 };
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < numWorkers; ++w) {
+        workers.emplace_back([&, w] {
+            size_t index;
+            while (queues.next(w, index)) {
+                const auto& job = jobs[index];
+                juce::String error;
+                if (renderers[(size_t) w]->render(job, error)) {
+                    rendered[index] = 1;
+                    if (!isPart[index])
+                        print(stdout, "%s\n", job.output.getFullPathName().toRawUTF8());
+                } else {
+                    print(stderr, "OfflineRender: %s\n", error.toRawUTF8());
+                    if (!isPart[index])
+                        ++failures;
+                }
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    for (const auto& file : chunked) {
+        const bool complete = std::all_of(file.chunks.begin(), file.chunks.end(), [&](size_t chunk) { return rendered[chunk] != 0; })
+                              && (!options.verify || rendered[file.sequential] != 0);
+        juce::String error = "cannot render " + file.whole.input.getFullPathName();
+        if (complete && stitch(file, jobs, options, error)) {
+            print(stdout, "%s\n", file.whole.output.getFullPathName().toRawUTF8());
+        } else {
+            print(stderr, "OfflineRender: %s\n", error.toRawUTF8());
+            for (size_t chunk : file.chunks)
+                jobs[chunk].output.deleteFile();
+            if (options.verify)
+                jobs[file.sequential].output.deleteFile();
+            ++failures;
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr, "OfflineRender: %d of %d files in %.1f s on %d workers\n", (int) files.size() - failures.load(), (int) files.size(),
+                 seconds, numWorkers);
+
+    return failures.load() == 0 ? 0 : 1;
+}
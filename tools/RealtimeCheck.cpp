@@ -0,0 +1,518 @@
+// Real-time safety check for PunkDistAudioProcessor::processBlock. Runs the processor over
+// random sample rates, channel layouts, block sizes, input and parameter changes, with hooks
+// that flag any allocation, lock or blocking system call made while processBlock is on the
+// stack. Exits with 1 on the first kind of violation found and prints where it happened,
+// along with the worst block times seen.
+//
+//   RealtimeCheck [--trials n] [--seconds s] [--seed n]
+//
+// operator new/delete are caught everywhere. On Linux (glibc) malloc and friends, mutexes,
+// condition variables, semaphores, sleeps, read/write/poll and mmap are interposed as well,
+// and a voluntary context switch during a block counts as blocking. Parameter changes are
+// delivered between blocks the way plugin wrappers do, so JUCE's own listener lock is not
+// blamed on the processor.
+
+// The hooks define libc functions, which the fortified inline wrappers would clash with
+#undef _FORTIFY_SOURCE
+
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__GLIBC__)
+    #define REALTIME_CHECK_INTERPOSE 1
+    #include <cerrno>
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <semaphore.h>
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+#else
+    #define REALTIME_CHECK_INTERPOSE 0
+#endif
+
+namespace
+{
+    enum Violation
+    {
+        Allocation = 0,
+        Deallocation,
+        Lock,
+        SystemCall,
+        Blocked,
+        numViolations
+    };
+
+    const char* const violationNames[numViolations] = { "allocation", "deallocation", "lock", "system call", "blocking (context switch)" };
+
+    // Only the audio thread, and only inside processBlock
+    thread_local bool auditing = false;
+
+    // First occurrence of each kind: written by the audio thread with auditing on, read
+    // after it stops, so nothing here allocates or locks
+    std::atomic<int> counts[numViolations];
+    const char* firstCall[numViolations];
+    void* firstStack[numViolations][48];
+    int firstStackDepth[numViolations];
+
+    void violation(Violation kind, const char* call) noexcept
+    {
+        if (!auditing)
+            return;
+
+        // Whatever the hook forwards to must not be flagged again
+        auditing = false;
+        if (counts[kind].fetch_add(1, std::memory_order_relaxed) == 0) {
+            firstCall[kind] = call;
+#if REALTIME_CHECK_INTERPOSE
+            firstStackDepth[kind] = backtrace(firstStack[kind], 48);
+#endif
+        }
+        auditing = true;
+    }
+
+    void* allocate(size_t size)
+    {
+#if REALTIME_CHECK_INTERPOSE
+        return __libc_malloc(size);
+#else
+        return std::malloc(size);
+#endif
+    }
+
+    void release(void* pointer)
+    {
+#if REALTIME_CHECK_INTERPOSE
+        __libc_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+
+    void* allocateOrThrow(size_t size)
+    {
+        violation(Allocation, "operator new");
+        if (void* pointer = allocate(size == 0 ? 1 : size))
+            return pointer;
+        throw std::bad_alloc();
+    }
+}
+
+//==============================================================================
+// Hooks
+
+void* operator new(size_t size) { return allocateOrThrow(size); }
+void* operator new[](size_t size) { return allocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    violation(Allocation, "operator new");
+    return allocate(size == 0 ? 1 : size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    violation(Allocation, "operator new[]");
+    return allocate(size == 0 ? 1 : size);
+}
+void operator delete(void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        violation(Deallocation, "operator delete");
+    release(pointer);
+}
+void operator delete[](void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        violation(Deallocation, "operator delete[]");
+    release(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept { operator delete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { operator delete[](pointer); }
+
+#if REALTIME_CHECK_INTERPOSE
+namespace
+{
+    // Looked up on first use rather than during static initialisation, which other
+    // initialisers may already be locking or writing in
+    template <typename Function>
+    Function next(std::atomic<Function>& cached, const char* name) noexcept
+    {
+        Function function = cached.load(std::memory_order_relaxed);
+        if (function == nullptr) {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+            cached.store(function, std::memory_order_relaxed);
+        }
+        return function;
+    }
+}
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        violation(Allocation, "malloc");
+        return __libc_malloc(size);
+    }
+    void* calloc(size_t count, size_t size)
+    {
+        violation(Allocation, "calloc");
+        return __libc_calloc(count, size);
+    }
+    void* realloc(void* pointer, size_t size)
+    {
+        violation(Allocation, "realloc");
+        return __libc_realloc(pointer, size);
+    }
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        violation(Allocation, "aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+    int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        violation(Allocation, "posix_memalign");
+        *pointer = __libc_memalign(alignment, size);
+        return *pointer != nullptr ? 0 : ENOMEM;
+    }
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            violation(Deallocation, "free");
+        __libc_free(pointer);
+    }
+
+    // Try-locks never wait, so they are allowed
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        static std::atomic<int (*)(pthread_mutex_t*)> real { nullptr };
+        violation(Lock, "pthread_mutex_lock");
+        return next(real, "pthread_mutex_lock")(mutex);
+    }
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+    {
+        static std::atomic<int (*)(pthread_rwlock_t*)> real { nullptr };
+        violation(Lock, "pthread_rwlock_rdlock");
+        return next(real, "pthread_rwlock_rdlock")(lock);
+    }
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+    {
+        static std::atomic<int (*)(pthread_rwlock_t*)> real { nullptr };
+        violation(Lock, "pthread_rwlock_wrlock");
+        return next(real, "pthread_rwlock_wrlock")(lock);
+    }
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        static std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> real { nullptr };
+        violation(Lock, "pthread_cond_wait");
+        return next(real, "pthread_cond_wait")(condition, mutex);
+    }
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* time)
+    {
+        static std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*, const timespec*)> real { nullptr };
+        violation(Lock, "pthread_cond_timedwait");
+        return next(real, "pthread_cond_timedwait")(condition, mutex, time);
+    }
+    int sem_wait(sem_t* semaphore)
+    {
+        static std::atomic<int (*)(sem_t*)> real { nullptr };
+        violation(Lock, "sem_wait");
+        return next(real, "sem_wait")(semaphore);
+    }
+    int sem_timedwait(sem_t* semaphore, const timespec* time)
+    {
+        static std::atomic<int (*)(sem_t*, const timespec*)> real { nullptr };
+        violation(Lock, "sem_timedwait");
+        return next(real, "sem_timedwait")(semaphore, time);
+    }
+
+    ssize_t read(int file, void* data, size_t size)
+    {
+        static std::atomic<ssize_t (*)(int, void*, size_t)> real { nullptr };
+        violation(SystemCall, "read");
+        return next(real, "read")(file, data, size);
+    }
+    ssize_t write(int file, const void* data, size_t size)
+    {
+        static std::atomic<ssize_t (*)(int, const void*, size_t)> real { nullptr };
+        violation(SystemCall, "write");
+        return next(real, "write")(file, data, size);
+    }
+    int poll(pollfd* files, nfds_t numFiles, int timeout)
+    {
+        static std::atomic<int (*)(pollfd*, nfds_t, int)> real { nullptr };
+        violation(SystemCall, "poll");
+        return next(real, "poll")(files, numFiles, timeout);
+    }
+    int nanosleep(const timespec* duration, timespec* remaining)
+    {
+        static std::atomic<int (*)(const timespec*, timespec*)> real { nullptr };
+        violation(SystemCall, "nanosleep");
+        return next(real, "nanosleep")(duration, remaining);
+    }
+    int usleep(useconds_t duration)
+    {
+        static std::atomic<int (*)(useconds_t)> real { nullptr };
+        violation(SystemCall, "usleep");
+        return next(real, "usleep")(duration);
+    }
+    int sched_yield()
+    {
+        static std::atomic<int (*)()> real { nullptr };
+        violation(SystemCall, "sched_yield");
+        return next(real, "sched_yield")();
+    }
+    void* mmap(void* address, size_t size, int protection, int flags, int file, off_t offset)
+    {
+        static std::atomic<void* (*)(void*, size_t, int, int, int, off_t)> real { nullptr };
+        violation(SystemCall, "mmap");
+        return next(real, "mmap")(address, size, protection, flags, file, offset);
+    }
+    int munmap(void* address, size_t size)
+    {
+        static std::atomic<int (*)(void*, size_t)> real { nullptr };
+        violation(SystemCall, "munmap");
+        return next(real, "munmap")(address, size);
+    }
+}
+#endif
+
+//==============================================================================
+namespace
+{
+    struct Options
+    {
+        int trials = 100;
+        double seconds = 2.0;
+        unsigned int seed = 1;
+    };
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            const std::string arg = argv[i];
+            const std::string value = argv[i + 1];
+            if (arg == "--trials")
+                options.trials = std::max(1, std::stoi(value));
+            else if (arg == "--seconds")
+                options.seconds = std::max(0.01, std::stod(value));
+            else if (arg == "--seed")
+                options.seed = (unsigned int) std::stoul(value);
+            else
+                return false;
+        }
+        return argc % 2 == 1;
+    }
+
+    struct Config
+    {
+        double sampleRate;
+        int numChannels;
+        int maxBlockSize;
+    };
+
+    struct Worst
+    {
+        double seconds = 0.0, load = 0.0; // load: share of the block's own duration
+        Config config {};
+        int blockSize = 0;
+    };
+
+    int firstViolation()
+    {
+        for (int kind = 0; kind < numViolations; ++kind)
+            if (counts[kind].load() > 0)
+                return kind;
+        return -1;
+    }
+
+    void report(int kind, const Config& config, int blockSize)
+    {
+        std::fprintf(stderr, "RealtimeCheck: %s in processBlock (%s) at %g Hz, %d channels, %d of %d samples\n", violationNames[kind],
+                     firstCall[kind] != nullptr ? firstCall[kind] : "?", config.sampleRate, config.numChannels, blockSize, config.maxBlockSize);
+#if REALTIME_CHECK_INTERPOSE
+        backtrace_symbols_fd(firstStack[kind], firstStackDepth[kind], 2);
+#endif
+    }
+
+    // Noise, tones and silence in random stretches, so idle sleep and wake-up get exercised
+    class Signal
+    {
+    public:
+        Signal(std::mt19937& randomToUse, double sampleRateToUse) : random(randomToUse), sampleRate(sampleRateToUse) {}
+
+        void fill(juce::AudioBuffer<float>& buffer, int numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i) {
+                if (remaining-- <= 0)
+                    next();
+
+                float x = 0.0f;
+                if (kind == 1)
+                    x = level * std::uniform_real_distribution<float>(-1.0f, 1.0f)(random);
+                else if (kind == 2)
+                    x = level * (float) std::sin(phase += increment);
+
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    buffer.setSample(ch, i, x);
+            }
+        }
+
+    private:
+        void next()
+        {
+            kind = std::uniform_int_distribution<int>(0, 2)(random);
+            level = juce::Decibels::decibelsToGain(std::uniform_real_distribution<float>(-40.0f, 0.0f)(random));
+            increment = juce::MathConstants<double>::twoPi * std::uniform_real_distribution<double>(40.0, 4000.0)(random) / sampleRate;
+            remaining = std::uniform_int_distribution<int>(1, (int) (0.5 * sampleRate))(random);
+        }
+
+        std::mt19937& random;
+        double sampleRate;
+        int kind = 0, remaining = 0;
+        float level = 0.0f;
+        double phase = 0.0, increment = 0.0;
+    };
+
+    // The host side of automation: what a plugin wrapper does before calling processBlock
+    void automate(PunkDistAudioProcessor& processor, std::mt19937& random)
+    {
+        auto& parameters = processor.getParameters();
+        auto* parameter = parameters[std::uniform_int_distribution<int>(0, parameters.size() - 1)(random)];
+        const int steps = parameter->getNumSteps();
+        float value = std::uniform_real_distribution<float>(0.0f, 1.0f)(random);
+        if (steps > 1 && steps < 100)
+            value = (float) std::uniform_int_distribution<int>(0, steps - 1)(random) / (float) (steps - 1);
+
+        parameter->setValue(value);
+        parameter->sendValueChangedMessageToListeners(value);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: RealtimeCheck [--trials n] [--seconds s] [--seed n]\n");
+        return 1;
+    }
+
+#if REALTIME_CHECK_INTERPOSE
+    // The unwinder loads on first use; that must not happen inside a hook
+    void* warmUp[4];
+    backtrace(warmUp, 4);
+#endif
+
+    // The processor's parameters and async updates expect a message manager to exist
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const double sampleRates[] = { 22050.0, 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+    const int channelCounts[] = { 1, 2, 3, 4, 6, 8 };
+    const int blockSizes[] = { 16, 32, 64, 100, 128, 256, 441, 512, 1024, 2048, 4096 };
+
+    std::mt19937 random(options.seed);
+    PunkDistAudioProcessor processor;
+    Worst worst;
+    std::vector<double> loads;
+    juce::int64 numBlocks = 0;
+
+    for (int trial = 0; trial < options.trials; ++trial) {
+        const Config config { sampleRates[random() % std::size(sampleRates)], channelCounts[random() % std::size(channelCounts)],
+                              blockSizes[random() % std::size(blockSizes)] };
+
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(juce::AudioChannelSet::canonicalChannelSet(config.numChannels));
+        layout.outputBuses.add(juce::AudioChannelSet::canonicalChannelSet(config.numChannels));
+        if (!processor.setBusesLayout(layout))
+            continue;
+
+        processor.setNonRealtime(random() % 8 == 0);
+        processor.setRateAndBufferSizeDetails(config.sampleRate, config.maxBlockSize);
+        processor.prepareToPlay(config.sampleRate, config.maxBlockSize);
+
+        // Half the trials reload the model part way, so the crossfade runs on the audio thread
+        const bool swapModel = trial % 2 == 1;
+        const juce::int64 totalSamples = (juce::int64) (options.seconds * config.sampleRate);
+        bool failed = false;
+
+        std::thread audio([&] {
+            juce::AudioBuffer<float> buffer(config.numChannels, config.maxBlockSize);
+            juce::MidiBuffer midi;
+            Signal signal(random, config.sampleRate);
+#if REALTIME_CHECK_INTERPOSE
+            rusage before, after;
+#endif
+
+            for (juce::int64 done = 0; done < totalSamples && !failed;) {
+                // Hosts mostly send full blocks, with the odd short one
+                const int blockSize = random() % 4 == 0 ? (int) (random() % (unsigned) config.maxBlockSize) + 1 : config.maxBlockSize;
+                buffer.setSize(config.numChannels, blockSize, false, false, true);
+                signal.fill(buffer, blockSize);
+                if (random() % 16 == 0)
+                    automate(processor, random);
+                if (swapModel && done < totalSamples / 2 && done + blockSize >= totalSamples / 2)
+                    processor.loadModel({});
+
+#if REALTIME_CHECK_INTERPOSE
+                getrusage(RUSAGE_THREAD, &before);
+#endif
+                const auto start = std::chrono::steady_clock::now();
+                auditing = true;
+                processor.processBlock(buffer, midi);
+                auditing = false;
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#if REALTIME_CHECK_INTERPOSE
+                getrusage(RUSAGE_THREAD, &after);
+                if (after.ru_nvcsw > before.ru_nvcsw && counts[Blocked].fetch_add(1) == 0)
+                    firstCall[Blocked] = "voluntary context switch";
+#endif
+
+                const double load = seconds * config.sampleRate / blockSize;
+                loads.push_back(load);
+                if (seconds > worst.seconds)
+                    worst = { seconds, load, config, blockSize };
+
+                const int kind = firstViolation();
+                if (kind >= 0) {
+                    report(kind, config, blockSize);
+                    failed = true;
+                }
+
+                done += blockSize;
+                ++numBlocks;
+            }
+        });
+        audio.join();
+        processor.releaseResources();
+
+        if (failed)
+            return 1;
+    }
+
+    std::sort(loads.begin(), loads.end());
+    std::fprintf(stderr, "RealtimeCheck: %lld blocks in %d trials, no allocations, locks or blocking calls\n", (long long) numBlocks, options.trials);
+    if (!loads.empty())
+        std::fprintf(stderr, "RealtimeCheck: block load p50 %.1f%%, p99 %.1f%%, max %.1f%%\n", 100.0 * loads[loads.size() / 2],
+                     100.0 * loads[(size_t) (0.99 * (double) (loads.size() - 1))], 100.0 * loads.back());
+    std::fprintf(stderr, "RealtimeCheck: slowest block %.3f ms (%d samples at %g Hz, %d channels, %.1f%% of its duration)\n", worst.seconds * 1000.0,
+                 worst.blockSize, worst.config.sampleRate, worst.config.numChannels, 100.0 * worst.load);
+    return 0;
+}